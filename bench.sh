@@ -0,0 +1,2 @@
+#!/usr/bin/env bash
+gcc `pkg-config --cflags --libs notcurses-core` -O2 -DBENCH -o unn-bench src/unn.c && ./unn-bench
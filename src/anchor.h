@@ -0,0 +1,277 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_ANCHOR_H_
+#define __UNN_ANCHOR_H_
+
+#include <stdlib.h>
+
+#include "line.h"
+
+// a position in a buffer that follows it's edits. anchors of a buffer are kept
+// in a treap ordered by (index, pos), a node's shift is added to the indexes of
+// it's whole subtree lazily, so lines inserted or removed before any amount of
+// anchors cost O(log n). anchors are owned by whoever embeds them
+typedef struct anchor {
+    struct anchor *left, *right, *parent;
+    struct anchors *owner; // NULL while the anchor isn't attached
+
+    unsigned int prio;
+    int shift; // pending for the subtree, including the anchor itself
+
+    line *l;
+    int index, pos;
+} anchor;
+
+typedef struct anchors {
+    anchor *root;
+    int count;
+    unsigned int seed;
+} anchors;
+
+inline static void _anchor_push(anchor *a) {
+    if(!a->shift) return;
+
+    a->index += a->shift;
+
+    if(a->left) a->left->shift += a->shift;
+    if(a->right) a->right->shift += a->shift;
+
+    a->shift = 0;
+}
+
+// so that the anchor's own index is up to date
+static void _anchor_push_path(anchor *a) {
+    if(a->parent) _anchor_push_path(a->parent);
+    _anchor_push(a);
+}
+
+inline static char _anchor_before(anchor *a, int index, int pos) {
+    return a->index < index || (a->index == index && a->pos < pos);
+}
+
+// *lt gets the anchors before (index, pos), *ge the rest
+static void _anchor_split(anchor *t, int index, int pos, anchor **lt, anchor **ge) {
+    if(!t) {
+        *lt = NULL;
+        *ge = NULL;
+        return;
+    }
+
+    _anchor_push(t);
+
+    if(_anchor_before(t, index, pos)) {
+        _anchor_split(t->right, index, pos, &t->right, ge);
+        if(t->right) t->right->parent = t;
+        *lt = t;
+    } else {
+        _anchor_split(t->left, index, pos, lt, &t->left);
+        if(t->left) t->left->parent = t;
+        *ge = t;
+    }
+}
+
+// every anchor of a is before every anchor of b
+static anchor *_anchor_merge(anchor *a, anchor *b) {
+    if(!a) return b;
+    if(!b) return a;
+
+    if(a->prio > b->prio) {
+        _anchor_push(a);
+        a->right = _anchor_merge(a->right, b);
+        a->right->parent = a;
+        return a;
+    }
+
+    _anchor_push(b);
+    b->left = _anchor_merge(a, b->left);
+    b->left->parent = b;
+    return b;
+}
+
+int anchor_index(anchor *a) {
+    int index = a->index;
+
+    for(anchor *p = a; p; p = p->parent) {
+        index += p->shift;
+    }
+
+    return index;
+}
+
+void anchor_detach(anchor *a) {
+    anchors *as = a->owner;
+
+    if(!as) return;
+
+    _anchor_push_path(a);
+
+    anchor *m = _anchor_merge(a->left, a->right);
+    anchor *p = a->parent;
+
+    if(m) m->parent = p;
+
+    if(!p) {
+        as->root = m;
+    } else if(p->left == a) {
+        p->left = m;
+    } else {
+        p->right = m;
+    }
+
+    as->count--;
+
+    a->left = a->right = a->parent = NULL;
+    a->owner = NULL;
+}
+
+// (re)attach the anchor at the position
+void anchor_attach(anchors *as, anchor *a, line *l, int index, int pos) {
+    if(a->owner) anchor_detach(a);
+
+    // xorshift, the priorities only have to be spread
+    unsigned int x = as->seed ? as->seed : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    as->seed = x;
+
+    *a = (anchor) {
+        .owner = as,
+        .prio = x,
+        .l = l,
+        .index = index,
+        .pos = pos,
+    };
+
+    anchor *lt, *ge;
+    _anchor_split(as->root, index, pos, &lt, &ge);
+
+    as->root = _anchor_merge(_anchor_merge(lt, a), ge);
+    as->root->parent = NULL;
+    as->count++;
+}
+
+// attach the anchor unless it's already there
+void anchor_set(anchors *as, anchor *a, line *l, int index, int pos) {
+    if(a->owner == as && a->l == l && a->pos == pos && anchor_index(a) == index) return;
+
+    anchor_attach(as, a, l, index, pos);
+}
+
+// the anchors are left in place, only detached
+static void _anchors_forget(anchor *t) {
+    if(!t) return;
+
+    _anchors_forget(t->left);
+    _anchors_forget(t->right);
+
+    t->left = t->right = t->parent = NULL;
+    t->owner = NULL;
+    t->shift = 0;
+}
+
+void anchors_clear(anchors *as) {
+    _anchors_forget(as->root);
+
+    as->root = NULL;
+    as->count = 0;
+}
+
+// anchors after the line index are moved by count lines
+static void _anchors_shift(anchor *t, int index, int count) {
+    while(t) {
+        _anchor_push(t);
+
+        if(t->index > index) {
+            t->index += count;
+            if(t->right) t->right->shift += count;
+            t = t->left;
+        } else {
+            t = t->right;
+        }
+    }
+}
+
+// text from (index, pos) up to (end_index, end_pos) is replaced. anchors within it
+// go to (to_index, to_pos), anchors after it on end_index keep their distance from
+// it's end. the order of the anchors is kept, so they're changed in place
+typedef struct _anchors_edit {
+    int index, pos;
+    int end_index, end_pos;
+    line *l;
+    int to_index, to_pos;
+} _anchors_edit;
+
+static void _anchors_move(anchor *t, _anchors_edit *e) {
+    if(!t) return;
+
+    _anchor_push(t);
+
+    char after_start = !_anchor_before(t, e->index, e->pos);
+    char before_end = t->index <= e->end_index;
+
+    if(after_start) _anchors_move(t->left, e);
+
+    if(after_start && before_end) {
+        if(_anchor_before(t, e->end_index, e->end_pos)) {
+            t->pos = e->to_pos;
+        } else {
+            t->pos = e->to_pos + t->pos - e->end_pos;
+        }
+
+        t->index = e->to_index;
+        t->l = e->l;
+    }
+
+    if(before_end) _anchors_move(t->right, e);
+}
+
+// text was inserted at (index, pos) and ended at (index + lines, end_pos) on line l
+void anchors_insert(anchors *as, int index, int pos, int lines, line *l, int end_pos) {
+    if(!as->root) return;
+
+    if(lines) _anchors_shift(as->root, index, lines);
+
+    _anchors_edit e = {
+        .index = index, .pos = pos,
+        .end_index = index, .end_pos = pos,
+        .l = l,
+        .to_index = index + lines, .to_pos = end_pos,
+    };
+
+    _anchors_move(as->root, &e);
+}
+
+// text from (index, pos) up to (end_index, end_pos) was removed, l is the line at index
+void anchors_remove(anchors *as, int index, int pos, int end_index, int end_pos, line *l) {
+    if(!as->root) return;
+
+    _anchors_edit e = {
+        .index = index, .pos = pos,
+        .end_index = end_index, .end_pos = end_pos,
+        .l = l,
+        .to_index = index, .to_pos = pos,
+    };
+
+    _anchors_move(as->root, &e);
+
+    if(end_index > index) _anchors_shift(as->root, end_index, index - end_index);
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_BENCH_H_
+#define __UNN_BENCH_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "state.h"
+#include "logic.h"
+#include "commands.h"
+
+// render microbenchmark, built by bench.sh instead of the editor.
+// the windows are drawn in the terminal without the loops' threads,
+// the results are printed once notcurses has stopped
+
+#define BENCH_LINES 5000
+#define BENCH_FRAMES 500
+
+typedef struct bench_result {
+    const char *name;
+    long frames;
+    long us;
+    long cells;
+} bench_result;
+
+#define BENCH_CASES 4
+
+bench_result bench_results[BENCH_CASES] = { 0 };
+int bench_results_len = 0;
+
+// ascii code with tabs, wide chars and lines longer than the window
+inline static int bench_fill(window *w) {
+    static wchar_t text[BENCH_LINES * 128];
+    int len = 0;
+
+    for(int i = 0; i < BENCH_LINES; i++) {
+        const wchar_t *fmt = (i % 7 == 3) ? L"\t\tname_%d = 値(%d); // コメント\n" :
+            (i % 11 == 5) ? L"%d %d long line long line long line long line long line long line long line long line\n" :
+            L"    int value_%d = compute(%d, other);\n";
+
+        int n = swprintf(text + len, sizeof(text) / sizeof(*text) - len, fmt, i, i * 7);
+
+        if(n < 0) return -1;
+
+        len += n;
+    }
+
+    if(buffer_insert_text_at_cursor(w, text, len) < 0) return -1;
+
+    cursor_set(w, w->buff->first, 0, 0, 0);
+
+    return 0;
+}
+
+inline static void bench_add(const char *name, struct timespec *start, long frames, long cells) {
+    if(bench_results_len == BENCH_CASES) return;
+
+    bench_results[bench_results_len++] = (bench_result) {
+        .name = name,
+        .frames = frames,
+        .us = elapsed_us(start),
+        .cells = cells,
+    };
+}
+
+// the whole screen drawn again, as draw_loop does for FLAG_DRAW_ALL
+inline static void bench_full(const char *name) {
+    struct timespec start;
+    long cells = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(int i = 0; i < BENCH_FRAMES; i++) {
+        draw_cells = 0;
+
+        ncplane_erase(S.p);
+
+        for(window *w = S.grid->first; w != NULL; w = w->next) {
+            window_drawn_invalidate(w);
+        }
+        status_invalidate();
+
+        draw_grid(S.p, S.grid);
+        draw_status(S.p);
+
+        cells += draw_cells;
+    }
+
+    bench_add(name, &start, BENCH_FRAMES, cells);
+}
+
+// the cursor moved down a line a frame, only the window is drawn
+inline static void bench_scroll(const char *name) {
+    struct timespec start;
+    long cells = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(int i = 0; i < BENCH_FRAMES; i++) {
+        draw_cells = 0;
+
+        cursor_down_n(1);
+        draw_pending_windows();
+
+        cells += draw_cells;
+    }
+
+    bench_add(name, &start, BENCH_FRAMES, cells);
+}
+
+// drawn planes into a frame, the terminal isn't written to
+inline static void bench_render(const char *name) {
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(int i = 0; i < BENCH_FRAMES; i++) {
+        ncplane_erase(S.p);
+
+        for(window *w = S.grid->first; w != NULL; w = w->next) {
+            window_drawn_invalidate(w);
+        }
+        status_invalidate();
+
+        draw_grid(S.p, S.grid);
+        draw_status(S.p);
+
+        ncpile_render(S.p);
+    }
+
+    bench_add(name, &start, BENCH_FRAMES, 0);
+}
+
+int bench_run() {
+    if(e.code) return -1;
+
+    window *w = S.current_window;
+
+    if(bench_fill(w)) {
+        err_set(&e, -4, L"not enough memory");
+        return -1;
+    }
+
+    bench_full("full redraw");
+    bench_scroll("scroll a line");
+    bench_render("full redraw + render");
+
+    current_window_toggle_wrap();
+    cursor_set(w, w->buff->first, 0, 0, 0);
+
+    bench_full("full redraw, wrapped");
+
+    return 0;
+}
+
+// called at exit after unn_cleanup, the terminal is usable again
+void bench_print() {
+    for(int i = 0; i < bench_results_len; i++) {
+        bench_result *r = bench_results + i;
+
+        printf("%-24s %6ld frames %10.1f us/frame", r->name, r->frames, (double)r->us / r->frames);
+
+        if(r->cells) printf(" %8ld cells/frame", r->cells / r->frames);
+
+        printf("\n");
+    }
+}
+
+#endif
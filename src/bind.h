@@ -19,6 +19,7 @@
 #ifndef __UNN_BIND_H_
 #define __UNN_BIND_H_
 
+#include <ctype.h>
 #include <stdlib.h>
 
 #include "misc.h"
@@ -31,49 +32,53 @@ typedef void(*num_tusk)(int); // for parametered commands such as jump line
 #define TUSK_CONT ((tusk) 1)
 #define TUSK_NOP ((tusk) 2)
 
+// what's done with a count typed before the sequence, "3cwo"
+#define BIND_COUNT_NONE 0 // the count is dropped, cb is called once
+#define BIND_COUNT_NUM 1 // num_cb is called with the count
+#define BIND_COUNT_REPEAT 2 // cb is called count times
+
 typedef struct ubind {
-    char is_cont, is_num;
+    char is_cont, count; // count is one of BIND_COUNT_*
     const char *seq;
     union {
-        tusk cb, num_cb;
+        tusk cb;
+        num_tusk num_cb; // BIND_COUNT_NUM
         struct ubind *cont;
     };
 } ubind;
 
-typedef struct bucket {
-    char bind[16]; // that's enough for now... :()
-    tusk cb;
-    struct bucket *next;
-} bucket;
+#define BINDS_KEYS 128 // keys are ascii chars, the rest is never bound
+#define BINDS_NODES_MAX 65535
 
-typedef struct binds {
-    int flags;
-    size_t len, cap;
-    bucket **bucks;
-} binds;
+// "(ab)" chords are stepped by these around their keys, so that a typed '(' stays
+// a key of it's own. control chars that are never taken as typed keys, see binds_key
+#define BINDS_CHORD_OPEN '\x0e'
+#define BINDS_CHORD_CLOSE '\x0f'
 
-size_t bad_hash(const char *str) {
-    if(!str) return 0;
+// a bound sequence is a path from the root node, one node per key.
+// chords take four nodes, their keys are always in order
+typedef struct bind_node {
+    tusk cb; // NULL if nothing is bound here, TUSK_CONT if only longer sequences are
+    char count; // BIND_COUNT_*, cb is a num_tusk for BIND_COUNT_NUM
+    unsigned short next[BINDS_KEYS]; // node after the key, 0 if there is none (root is never next)
+} bind_node;
 
-    size_t hash = 0;
+typedef struct binds {
+    int flags;
+    int changes; // unique among all binds, renewed by every binds_set
+    int len, cap;
+    bind_node *nodes; // nodes[0] is the root, the empty sequence
 
-    for(int i = 0; ; i++) {
-        char ch = str[i];
-        if(ch == 0) break;
-        hash += ch;
-    }
+    char sim_keys[128]; // keys that are a part of some simultaneous chord
+} binds;
 
-    return hash * 31;
-}
+// binds freed and allocated again at the same address still differ by it
+int binds_changes_last = 0;
 
 void binds_free(binds *b) {
     if(!b) return;
 
-    for(size_t i = 0; i < b->len; i++) {
-        free(b->bucks[i]);
-    }
-    
-    free(b->bucks);
+    free(b->nodes);
     free(b);
 }
 
@@ -82,135 +87,248 @@ binds *binds_empty() {
 
     if(!b) return NULL;
 
-    bucket **bucks = (bucket **)calloc(256, sizeof(*bucks));
+    bind_node *nodes = (bind_node *)calloc(64, sizeof(*nodes));
 
-    if(!bucks) {
+    if(!nodes) {
         free(b);
         return NULL;
     }
 
     b->flags = 0;
-    b->len = 0;
-    b->cap = 256;
-    b->bucks = bucks;
+    b->changes = ++binds_changes_last;
+    b->len = 1;
+    b->cap = 64;
+    b->nodes = nodes;
+
+    memset(b->sim_keys, 0, sizeof(b->sim_keys));
 
     return b;
 }
 
-inline static void _binds_add(binds *b, size_t hash, size_t index, char *seq, tusk cb) {
-    if(!b) return;
-    if(!seq) return;
+// the node after the key, created if there is none. returns -1 if it can't be
+inline static int _binds_child(binds *b, int node, char key) {
+    if(key & 128) return -1;
+
+    int next = b->nodes[node].next[(int)key];
+
+    if(next) return next;
+
+    if(b->len == BINDS_NODES_MAX) return -1;
+
+    if(b->len == b->cap) {
+        bind_node *nodes = (bind_node *)realloc(b->nodes, sizeof(*nodes) * b->cap * 2);
 
-    bucket *buck = (bucket *)malloc(sizeof(*buck));
+        if(!nodes) return -1;
 
-    if(!buck) {
-        return;
+        memset(nodes + b->cap, 0, sizeof(*nodes) * b->cap);
+
+        b->nodes = nodes;
+        b->cap *= 2;
     }
 
-    bucket **buck_ref = b->bucks + index;
-
-    memcpy(buck->bind, seq, 16);
-    buck->cb = cb;
-
-    if(!*buck_ref) {
-        *buck_ref = buck;
-        buck->next = NULL;
-    } else {
-        bucket *bk = *buck_ref;
-        while(1) {
-            if(!strcmp(seq, bk->bind)) {
-                free(buck);
-                bk->cb = cb;
-                return;
-            }
-
-            if(bk->next == NULL) {
-                bk->next = buck;
-                buck->next = NULL;
-                break;
-            }
-
-            bk = bk->next;
+    next = b->len++;
+    b->nodes[node].next[(int)key] = next;
+
+    return next;
+}
+
+inline static void _binds_cont(binds *b, int node) {
+    if(!b->nodes[node].cb) b->nodes[node].cb = TUSK_CONT;
+}
+
+int _binds_set(binds *b, int node, ubind *u) {
+    const char *seq = u->seq;
+
+    for(int i = 0; seq[i]; ) {
+        char keys[4] = { seq[i] };
+        int n = 1;
+
+        if(seq[i] == '(' && seq[i + 1] && seq[i + 2]) {
+            char ch1 = seq[i + 1];
+            char ch2 = seq[i + 2];
+
+            keys[0] = BINDS_CHORD_OPEN;
+            keys[1] = (ch1 < ch2) ? ch1 : ch2;
+            keys[2] = (ch1 < ch2) ? ch2 : ch1;
+            keys[3] = BINDS_CHORD_CLOSE;
+            n = 4;
+
+            b->sim_keys[ch1 & 127] = 1;
+            b->sim_keys[ch2 & 127] = 1;
         }
+
+        for(int k = 0; k < n; k++) {
+            if(node) _binds_cont(b, node);
+
+            node = _binds_child(b, node, keys[k]);
+
+            if(node < 0) return -1;
+        }
+
+        i += n;
     }
 
-    b->len++;
+    if(!u->is_cont) {
+        b->nodes[node].cb = (u->count == BIND_COUNT_NUM) ? (tusk)u->num_cb : u->cb;
+        b->nodes[node].count = u->count;
+        return 0;
+    }
+
+    _binds_cont(b, node);
+
+    for(ubind *ub = u->cont; ub->seq != NULL; ub++) {
+        if(_binds_set(b, node, ub)) return -1;
+    }
+
+    return 0;
 }
 
+// bind the sequence after the prefix, prefix may be NULL
 int binds_set(binds *b, const char *prefix, ubind *u) {
-    char seq[16] = { 0 };
-
-    if(prefix) { // begin with prefix if it exists
-        strncpy(seq, prefix, sizeof(seq) - 1);
-        int l = strlen(prefix);
-        strncpy(seq + l, u->seq, sizeof(seq) - 1 - l);
-    } else {
-        strncpy(seq, u->seq, sizeof(seq) - 1);
+    int node = 0;
+
+    b->changes = ++binds_changes_last;
+
+    for(int i = 0; prefix && prefix[i]; i++) {
+        if(node) _binds_cont(b, node);
+
+        node = _binds_child(b, node, prefix[i]);
+
+        if(node < 0) return -1;
+    }
+
+    return _binds_set(b, node, u);
+}
+
+// a typed key as stepped in the trie, the chord keys can't be typed
+inline static char binds_key(wchar_t wch) {
+    if(wch > 255 || wch == BINDS_CHORD_OPEN || wch == BINDS_CHORD_CLOSE) return '?';
+
+    return (char)wch;
+}
+
+// how the key is shown, chords as "(ab)"
+inline static char binds_key_shown(char key) {
+    if(key == BINDS_CHORD_OPEN) return '(';
+    if(key == BINDS_CHORD_CLOSE) return ')';
+
+    return (isprint(key)) ? key : '?';
+}
+
+// the node after the key, -1 if no bound sequence continues with it
+inline static int binds_step(binds *b, int node, char key) {
+    if(node < 0 || (key & 128)) return -1;
+
+    int next = b->nodes[node].next[(int)key];
+
+    return (next) ? next : -1;
+}
+
+inline static tusk binds_node_cb(binds *b, int node) {
+    return (node < 0) ? NULL : b->nodes[node].cb;
+}
+
+inline static char binds_node_count(binds *b, int node) {
+    return (node < 0) ? BIND_COUNT_NONE : b->nodes[node].count;
+}
+
+// bind everything of src's node at dst's node, src's binds override dst's ones
+int _binds_merge(binds *dst, int dnode, binds *src, int snode) {
+    bind_node *sn = src->nodes + snode;
+
+    if(sn->cb) {
+        dst->nodes[dnode].cb = sn->cb;
+        dst->nodes[dnode].count = sn->count;
     }
 
-    size_t hash = bad_hash(seq);
-    size_t index = hash % b->cap;
+    for(int key = 0; key < BINDS_KEYS; key++) {
+        int next = src->nodes[snode].next[key];
 
-    int useq_len = strlen(u->seq);
-    int prefix_len = (prefix) ? strlen(prefix) : 0;
-    int seq_len = useq_len + prefix_len;
+        if(!next) continue;
 
-    for(int i = prefix_len;;) {
-        if(i == seq_len) {
-            if(!u->is_cont) {
-                _binds_add(b, hash, index, seq, u->cb);
-            }
-            break;
-        }
+        int child = _binds_child(dst, dnode, (char)key);
 
-        if(seq[i++] == '(') {
-            char ch1 = seq[i];
-            char ch2 = seq[i + 1];
-            if(ch1 > ch2) {
-                seq[i] = ch2;
-                seq[i + 1] = ch1;
-            }
-            i += 3;
-        }
+        if(child < 0 || _binds_merge(dst, child, src, next)) return -1;
+    }
 
-        if((u->is_cont) || (i != seq_len)) {
-            char tmp = seq[i];
+    return 0;
+}
+
+#define BINDS_LAYERS 4
 
-            seq[i] = 0;
+// binds of several layers merged into a single trie, so that a key is a single step
+// however many of them override each other. rebuilt when any of the layers changes
+typedef struct binds_layered {
+    binds *merged;
+    binds *layers[BINDS_LAYERS];
+    int changes[BINDS_LAYERS];
+} binds_layered;
 
-            size_t h = bad_hash(seq);
-            size_t idx = h % b->cap;
+void binds_layered_free(binds_layered *bl) {
+    binds_free(bl->merged);
+    memset(bl, 0, sizeof(*bl));
+}
 
-            _binds_add(b, h, idx, seq, TUSK_CONT);
+// layers go from the bottom one up, NULL ones are skipped.
+// returns NULL if there are no layers or not enough memory
+binds *binds_layered_get(binds_layered *bl, binds **layers, int n) {
+    binds *top = NULL;
+    int count = 0;
 
-            seq[i] = tmp;
+    for(int i = 0; i < n; i++) {
+        if(layers[i]) {
+            top = layers[i];
+            count++;
         }
     }
 
-    if(u->is_cont) {
-        for(ubind *ub = u->cont; ub->seq != NULL; ub++) {
-            binds_set(b, seq, ub);
+    if(count <= 1) return top; // nothing to merge
+
+    char valid = (bl->merged != NULL);
+
+    for(int i = 0; i < BINDS_LAYERS && valid; i++) {
+        binds *layer = (i < n) ? layers[i] : NULL;
+
+        valid = (bl->layers[i] == layer) && (!layer || bl->changes[i] == layer->changes);
+    }
+
+    if(valid) return bl->merged;
+
+    binds_layered_free(bl);
+
+    binds *merged = binds_empty();
+
+    if(!merged) return NULL;
+
+    for(int i = 0; i < n && i < BINDS_LAYERS; i++) {
+        if(!layers[i]) continue;
+
+        if(_binds_merge(merged, 0, layers[i], 0)) {
+            binds_free(merged);
+            return NULL;
+        }
+
+        for(int k = 0; k < BINDS_KEYS; k++) {
+            merged->sim_keys[k] |= layers[i]->sim_keys[k];
         }
+
+        bl->layers[i] = layers[i];
+        bl->changes[i] = layers[i]->changes;
     }
 
-    return 0;
+    bl->merged = merged;
+
+    return merged;
 }
 
 tusk binds_get(binds *b, char *seq) {
-    size_t hash = bad_hash(seq);
-    size_t index = hash % b->cap;
+    int node = 0;
 
-    bucket *buck = b->bucks[index];
-
-    if (buck) {
-        for(; buck != NULL; buck = buck->next) {
-            if(!strcmp(buck->bind, seq)) {
-                return buck->cb;
-            }
-        }
+    for(int i = 0; seq[i] && node >= 0; i++) {
+        node = binds_step(b, node, seq[i]);
     }
 
-    return NULL;
+    return binds_node_cb(b, node);
 }
 
 #endif
\ No newline at end of file
@@ -26,14 +26,14 @@
 
 ubind WINDOW_BINDINGS[] = {
     { 0, 0, "c", { clear_input_buffer_and_move } }, // exit this continuation
-    { 0, 0, "o", { current_window_switch_other } }, // switch focus from current window to the other one
+    { 0, BIND_COUNT_REPEAT, "o", { current_window_switch_other } }, // switch focus from current window to the other one
     { 0, 0, "n", { new_window_command } }, // create new empty window, focus on it
-    { 0, 0, "g", { current_window_switch_prev } }, // switch focus from current window to the previous one
-    { 0, 0, "h", { current_window_switch_next } }, // switch focus from current window to the next one
-    { 0, 0, "w", { current_window_switch_up } }, // switch focus from current window to the nearest above one
-    { 0, 0, "s", { current_window_switch_left } }, // switch focus from current window to the nearest left one
-    { 0, 0, "k", { current_window_switch_right } }, // switch focus from current window to the nearest right one
-    { 0, 0, "m", { current_window_switch_down } }, // switch focus from current window to the nearest below one
+    { 0, BIND_COUNT_REPEAT, "g", { current_window_switch_prev } }, // switch focus from current window to the previous one
+    { 0, BIND_COUNT_REPEAT, "h", { current_window_switch_next } }, // switch focus from current window to the next one
+    { 0, BIND_COUNT_REPEAT, "w", { current_window_switch_up } }, // switch focus from current window to the nearest above one
+    { 0, BIND_COUNT_REPEAT, "s", { current_window_switch_left } }, // switch focus from current window to the nearest left one
+    { 0, BIND_COUNT_REPEAT, "k", { current_window_switch_right } }, // switch focus from current window to the nearest right one
+    { 0, BIND_COUNT_REPEAT, "m", { current_window_switch_down } }, // switch focus from current window to the nearest below one
     { 0, 0, "p", { current_window_switch_prompt } }, // switch to the prompt window
     { 0, 0, "dd", { current_window_destroy } }, // try to destroy current window
     { 0, 0, "do", { window_other_destroy } }, // try to destroy other window, selected from help window
@@ -84,16 +84,38 @@ ubind LINE_BINDINGS[] = {
     { 0, 0, NULL, { NULL } },
 };
 
+ubind MACRO_BINDINGS[] = {
+    { 0, 0, "c", { clear_input_buffer_and_move } }, // exit this continuation
+    { 0, 0, "r", { macro_toggle_record } }, // start recording processed keys, or stop it
+    { 0, 1, "e", { .num_cb = macro_play_n } }, // replay the recorded keys, count times
+    { 0, 1, "l", { .num_cb = macro_play_lines } }, // replay the recorded keys at the beginning of each of count lines
+    { 0, 0, NULL, { NULL } },
+};
+
+ubind MARK_BINDINGS[] = {
+    { 0, 0, "c", { clear_input_buffer_and_move } }, // exit this continuation
+    { 0, 0, "s", { mark_set } }, // put the buffer's mark at the cursor
+    { 0, 0, "j", { mark_swap } }, // jump to the mark, leaving it where the cursor was
+    { 0, 0, NULL, { NULL } },
+};
+
 ubind MOVE_BINDINGS[] = {
     { 1, 0, "c", { .cont = CONTROL_BINDINGS } },
     { 1, 0, "^", { .cont = CONTROL_BINDINGS } },
     { 1, 0, "l", { .cont = LINE_BINDINGS } },
-    { 0, 0, "w", { cursor_up } }, // cursor_up
-    { 0, 0, "s", { cursor_left } }, // cursor_left
-    { 0, 0, "k", { cursor_right } }, // cursor_right
-    { 0, 0, "m", { cursor_down } }, // cursor_down
-    { 0, 0, "f", { cursor_leap_word } }, // move cursor to the char after the end of a word
-    { 0, 0, "b", { cursor_leap_word_back } }, // move cursor to the char before the beginning of a word
+    { 1, 0, "q", { .cont = MACRO_BINDINGS } },
+    { 1, 0, "j", { .cont = MARK_BINDINGS } },
+    { 0, 1, "w", { .num_cb = cursor_up_n } }, // cursor_up, a count before moves that many at once: "250m"
+    { 0, 1, "s", { .num_cb = cursor_left_n } }, // cursor_left
+    { 0, 1, "k", { .num_cb = cursor_right_n } }, // cursor_right
+    { 0, 1, "m", { .num_cb = cursor_down_n } }, // cursor_down
+    { 0, 1, "dd", { .num_cb = current_buffer_delete_lines } }, // delete the cursor's line, or count lines from it
+    { 0, 1, "f", { .num_cb = cursor_leap_word_n } }, // move cursor to the beginning of the next word
+    { 0, 1, "b", { .num_cb = cursor_leap_word_back_n } }, // move cursor to the beginning of the previous word
+    { 0, 1, "tf", { .num_cb = cursor_leap_token_n } }, // same for tokens: "a->b" is three of them
+    { 0, 1, "tb", { .num_cb = cursor_leap_token_back_n } },
+    { 0, 1, "uf", { .num_cb = cursor_leap_subword_n } }, // same for parts of words: camelCase, snake_case
+    { 0, 1, "ub", { .num_cb = cursor_leap_subword_back_n } },
     // maybe move those to control?
     { 0, 0, "z", { cursor_fastmode_toggle } }, // move 5 units instead of 1
     { 0, 0, "x", { cursor_viewmode_toggle } }, // move view insted of cursor
@@ -102,11 +124,12 @@ ubind MOVE_BINDINGS[] = {
     // move to beg of view rect
     // move to end of view rect
     // move to line N
-    { 0, 0, "o", { cursor_rotate_view } }, // dislocate view around cursor(cur at top, cur at mid, cur at bot)
-    // enable selection
-    // copy selected to unn's clipboard and system clipboard
-    // paste selection from unn's clipboard cursor (consequent activations move clipboard's cursor)
-    // copy selection and then erase it
+    { 0, BIND_COUNT_REPEAT, "o", { cursor_rotate_view } }, // dislocate view around cursor(cur at top, cur at mid, cur at bot)
+    { 0, 0, "v", { selection_toggle } }, // begin selecting from the cursor, or stop
+    { 0, 0, "r", { selection_toggle_rect } }, // same for a rectangle of columns
+    { 0, 0, "y", { selection_copy } }, // copy the selection to the kill ring
+    { 0, 0, "g", { selection_cut } }, // copy the selection and then erase it
+    { 0, 1, "p", { .num_cb = kill_paste } }, // paste the latest kill, or the count-th latest one
     { 0, 0, "i", { mode_toggle } }, // switch mode to EDIT
     { 0, 0, "a", { enter_append } }, // move right once, switch mode to EDIT
     { 0, 0, NULL, { NULL } },
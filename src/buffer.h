@@ -22,7 +22,9 @@
 #include <stdlib.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
 
+#include "anchor.h"
 #include "bind.h"
 #include "list.h"
 #include "misc.h"
@@ -32,6 +34,17 @@
 
 #define BUFFER_PROMPT 1
 
+#define HL_VIEWS 4
+
+// lines shown by a window, highlighted before the rest of the buffer.
+// l is only valid while the buffer's changes are equal to changes
+typedef struct hl_view {
+    void *owner; // window, only used as a key
+    line *l;
+    int index, height;
+    int changes;
+} hl_view;
+
 typedef struct nwstr {
     struct nwstr *prev, *next;
 
@@ -59,6 +72,25 @@ typedef struct buffer {
     wchar_t *path, *name;
     int index;
     int flags;
+    int changes; // incremented on every contents modification
+
+    // highlighting, see highlight.h
+    const struct syntax *syn; // NULL if the buffer isn't highlighted
+    int hl_changes; // incremented when visible lines are recolored in the background
+    line *hl_next; // where the background highlighting continues, valid while changes == hl_next_changes
+    int hl_next_index, hl_next_changes;
+    hl_view hl_views[HL_VIEWS];
+
+    anchors anchors; // positions following the edits, see anchor.h
+    anchor mark; // set by the user, attached once it's set
+
+    // edit transactions, see buffer_begin
+    atomic_int tx_depth; // open transactions, the highlighting and drawing wait for the last one
+    atomic_char tx_draw; // the buffer's windows were ordered to be drawn meanwhile
+    char tx_changed; // tx_from and tx_to are attached
+    anchor tx_from, tx_to; // the first and the last edited lines meanwhile
+    char tx_held; // the transaction was opened by edits_hold
+    struct buffer *tx_held_next;
 
     pthread_mutex_t block;
 
@@ -66,6 +98,7 @@ typedef struct buffer {
 
     binds *move_binds;
     binds *edit_binds;
+    binds_layered binds_cache[2]; // the state's binds under the buffer's ones, by FLAG_EDIT
 
     struct window *current_window;
 
@@ -122,6 +155,10 @@ buffer *buffer_from_lines(const wchar_t *name, line *first, line *last, int line
 
     b->edit_binds = NULL;
     b->move_binds = NULL;
+
+    b->syn = NULL;
+    b->hl_next = NULL;
+    b->hl_next_changes = -1;
     
     pthread_mutex_init(&b->block, NULL);
 
@@ -140,6 +177,9 @@ void buffer_free(buffer *b) {
 
     node_free_nexts((node *)b->first, (free_func)line_free);
 
+    // windows still holding anchors in the buffer mustn't reach it
+    anchors_clear(&b->anchors);
+
     if(b->path)
         free(b->path);
 
@@ -154,6 +194,9 @@ void buffer_free(buffer *b) {
     if(b->move_binds)
         binds_free(b->move_binds);
 
+    binds_layered_free(&b->binds_cache[0]);
+    binds_layered_free(&b->binds_cache[1]);
+
     free(b);
 }
 
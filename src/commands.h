@@ -23,83 +23,138 @@
 #include "logic.h"
 
 #include <pthread.h>
+#include <stddef.h>
 
 void clear_input_buffer_and_move() {
-    S.input_buffer[0] = 0;
-    S.input_buffer_len = 0;
+    input_reset();
     state_flag_off(FLAG_EDIT);
     order_draw_status();
 }
 
-void cursor_up() {
+// counted moves are done at once, count is multiplied by 5 in the fast mode.
+// the moves read the lines and their cached columns, so the buffer's block is held:
+// the drawing copies the caches and the highlighting may replace the lines' chars
+void cursor_up_n(int count) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
-    int times = (state_flag_is_on(FLAG_FAST)) ? 5 : 1;
+    int times = count * ((state_flag_is_on(FLAG_FAST)) ? 5 : 1);
+
+    pthread_mutex_lock(&w->buff->block);
 
     int result;
     if(is_view) {
-        result = view_move(S.current_window, -times, 0);
+        result = view_move(w, -times, 0);
     } else {
-        result = cursor_move(S.current_window, -times, 0, 0);
+        result = cursor_move(w, -times, 0, 0);
     }
 
+    pthread_mutex_unlock(&w->buff->block);
+
     if(!result) { // if something has changed
-        order_draw_window(S.current_window);
+        order_draw_window(w);
     }
 }
 
-void cursor_down() {
+void cursor_down_n(int count) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
-    int times = (state_flag_is_on(FLAG_FAST)) ? 5 : 1;
+    int times = count * ((state_flag_is_on(FLAG_FAST)) ? 5 : 1);
+
+    pthread_mutex_lock(&w->buff->block);
 
     int result;
     if(is_view) {
-        result = view_move(S.current_window, times, 0);
+        result = view_move(w, times, 0);
     } else {
-        result = cursor_move(S.current_window, times, 0, 0);
+        result = cursor_move(w, times, 0, 0);
     }
 
+    pthread_mutex_unlock(&w->buff->block);
+
     if(!result) { // if something has changed
-        order_draw_window(S.current_window);
+        order_draw_window(w);
     }
 }
 
-void cursor_left() {
+void cursor_left_n(int count) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
-    int times = (state_flag_is_on(FLAG_FAST)) ? 5 : 1;
+    int times = count * ((state_flag_is_on(FLAG_FAST)) ? 5 : 1);
+
+    pthread_mutex_lock(&w->buff->block);
 
     int result;
     if(is_view) {
-        result = view_move(S.current_window, 0, -times);
+        result = view_move(w, 0, -times);
     } else {
-        result = cursor_move(S.current_window, 0, -times, 0);
+        result = cursor_move(w, 0, -times, 0);
         // if we want to cancel the last pos on an empty line we can just press 's'
-        S.current_window->last_pos = S.current_window->cur.pos;
+        w->last_col = line_col(w->cur.l, w->cur.pos);
     }
 
+    pthread_mutex_unlock(&w->buff->block);
+
     if(!result) { // if something has changed
-        order_draw_window(S.current_window);
+        order_draw_window(w);
     }
 }
 
-void cursor_right() {
+void cursor_right_n(int count) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
-    int times = (state_flag_is_on(FLAG_FAST)) ? 5 : 1;
+    int times = count * ((state_flag_is_on(FLAG_FAST)) ? 5 : 1);
+
+    pthread_mutex_lock(&w->buff->block);
 
     int result;
     if(is_view) {
-        result = view_move(S.current_window, 0, times);
+        result = view_move(w, 0, times);
     } else {
-        result = cursor_move(S.current_window, 0, times, 0);
+        result = cursor_move(w, 0, times, 0);
     }
 
+    pthread_mutex_unlock(&w->buff->block);
+
     if(!result) { // if something has changed
-        order_draw_window(S.current_window);
+        order_draw_window(w);
     }
 }
 
+void cursor_up() {
+    cursor_up_n(1);
+}
+
+void cursor_down() {
+    cursor_down_n(1);
+}
+
+void cursor_left() {
+    cursor_left_n(1);
+}
+
+void cursor_right() {
+    cursor_right_n(1);
+}
+
 void cursor_line_beg() {
+    if(!S.current_window || !S.current_window->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
 
+    pthread_mutex_lock(&S.current_window->buff->block);
+
     offset *off = &S.current_window->cur;
 
     if(is_view) {
@@ -112,11 +167,13 @@ void cursor_line_beg() {
         off->pos = 0;
     } else result = 1;
 
-    S.current_window->last_pos = 0;
+    S.current_window->last_col = 0;
 
     if(!is_view) {
         adjust_view_for_cursor(S.current_window);
     }
+
+    pthread_mutex_unlock(&S.current_window->buff->block);
     
     if(!result) { // if something has changed
         order_draw_window(S.current_window);
@@ -124,8 +181,12 @@ void cursor_line_beg() {
 }
 
 void cursor_line_end() {
+    if(!S.current_window || !S.current_window->buff) return;
+
     char is_view = state_flag_is_on(FLAG_VIEW);
 
+    pthread_mutex_lock(&S.current_window->buff->block);
+
     offset *off = &S.current_window->cur;
 
     if(is_view) {
@@ -137,92 +198,94 @@ void cursor_line_end() {
 
     if(off->pos != len) {
         off->pos = len;
-        S.current_window->last_pos = len;
+        S.current_window->last_col = line_width(off->l);
     } else result = 1;
 
     if(!is_view) {
         adjust_view_for_cursor(S.current_window);
     }
+
+    pthread_mutex_unlock(&S.current_window->buff->block);
     
     if(!result) { // if something has changed
         order_draw_window(S.current_window);
     }
 }
 
-void cursor_leap_word() {
-    if(!S.current_window) return;
+// leap count times to the next (dir > 0) or the previous boundary of the kind (see LINE_BOUND_*),
+// lines without any are passed at once. stops at the end or the beginning of the buffer
+void cursor_leap_n(int kind, int dir, int count) {
+    window *w = S.current_window;
 
-    offset *cur = &S.current_window->cur;
+    if(!w || !w->buff) return;
 
-    char after = 0;
+    offset *cur = &w->cur;
 
-    while (1) {
-        wchar_t ch = cur->l->dstr[cur->pos].wch;
+    pthread_mutex_lock(&w->buff->block);
 
-        if(ch == 0) {
-            if(cur->l->next) {
-                ch = L' ';
+    line *l = cur->l;
+    int index = cur->index;
+    int pos = cur->pos;
 
-                cur->l = cur->l->next;
-                cur->pos = -1;
-                cur->index++;
-            } else {
-                cur->pos = cur->l->len;
-                break;
-            }
-        }
+    for(int i = 0; i < count; i++) {
+        int to = (dir > 0) ? line_bound_next(l, kind, pos) : line_bound_prev(l, kind, pos);
+
+        while(to < 0) {
+            line *next = (dir > 0) ? l->next : l->prev;
 
-        if(after) {
-            if(!iswspace(ch)) {
+            if(!next) {
+                to = (dir > 0) ? l->len : 0;
                 break;
             }
-        } else if(iswspace(ch)) {
-            after = 1;
+
+            l = next;
+            index += dir;
+
+            to = (dir > 0) ? line_bound_next(l, kind, -1) : line_bound_prev(l, kind, l->len + 1);
         }
 
-        cur->pos++;
+        pos = to;
     }
 
-    adjust_view_for_cursor(S.current_window);
-    order_draw_window(S.current_window);
-}
+    if(l == cur->l && pos == cur->pos) {
+        pthread_mutex_unlock(&w->buff->block);
+        return;
+    }
 
-void cursor_leap_word_back() {
-    if(!S.current_window) return;
+    cur->l = l;
+    cur->index = index;
+    cur->pos = pos;
+    w->last_col = line_col(l, pos);
 
-    offset *cur = &S.current_window->cur;
+    adjust_view_for_cursor(w);
 
-    char after = 0;
+    pthread_mutex_unlock(&w->buff->block);
 
-    while (1) {
-        wchar_t ch = cur->l->dstr[cur->pos].wch;
+    order_draw_window(w);
+}
 
-        if(cur->pos == -1 && ch == 0) {
-            if(cur->l->prev) {
-                ch = L' ';
+void cursor_leap_word_n(int count) {
+    cursor_leap_n(LINE_BOUND_WORD, 1, count);
+}
 
-                cur->l = cur->l->prev;
-                cur->pos = cur->l->len;
-                cur->index--;
-            } else {
-                cur->pos = 0;
-                break;
-            }
-        }
+void cursor_leap_word_back_n(int count) {
+    cursor_leap_n(LINE_BOUND_WORD, -1, count);
+}
 
-        if(after) {
-            if(!iswspace(ch)) {
-                break;
-            }
-        } else if(iswspace(ch)) {
-            after = 1;
-        }
+void cursor_leap_token_n(int count) {
+    cursor_leap_n(LINE_BOUND_TOKEN, 1, count);
+}
 
-        cur->pos--;
-    }
+void cursor_leap_token_back_n(int count) {
+    cursor_leap_n(LINE_BOUND_TOKEN, -1, count);
+}
 
-    adjust_view_for_cursor(S.current_window);
-    order_draw_window(S.current_window);
+void cursor_leap_subword_n(int count) {
+    cursor_leap_n(LINE_BOUND_SUBWORD, 1, count);
+}
+
+void cursor_leap_subword_back_n(int count) {
+    cursor_leap_n(LINE_BOUND_SUBWORD, -1, count);
 }
 
 void cursor_fastmode_toggle() {
@@ -259,6 +322,8 @@ void buffer_newline_at_cursor() {
 
     offset *cur = &S.current_window->cur;
 
+    buffer_windows_anchor(S.current_window->buff, S.current_window);
+
     int new = (cur->l->len - cur->pos);
 
     line *l = line_empty(new + 4);
@@ -267,9 +332,14 @@ void buffer_newline_at_cursor() {
     line_append_multi(l, cur->l->dstr + cur->pos, cur->l->len - cur->pos);
 
         cur->l->len = cur->pos;
+        line_changed(cur->l);
     }
 
     list_insert_after(BUFFER_LIST(S.current_window->buff), (node *)cur->l, (node *)l);
+    anchors_insert(&S.current_window->buff->anchors, cur->index, cur->pos, 1, l, 0);
+    buffer_changed(S.current_window->buff, cur->l, cur->index, l, cur->index + 1);
+
+    buffer_windows_follow(S.current_window->buff, S.current_window);
 
     cur->l = l;
 
@@ -280,13 +350,14 @@ void buffer_newline_at_cursor() {
 
     pthread_mutex_unlock(&S.current_window->buff->block);
 
-    order_draw_window(S.current_window);
+    order_draw_buffer(S.current_window->buff);
 }
 
 void buffer_erase_at_cursor() {
     pthread_mutex_lock(&S.current_window->buff->block);
 
     offset *cur = &S.current_window->cur;
+    buffer *b = S.current_window->buff;
 
     if(cur->pos == 0) {
         line *prev = cur->l->prev;
@@ -296,26 +367,117 @@ void buffer_erase_at_cursor() {
             return;
         }
 
+        buffer_windows_anchor(b, S.current_window);
+
         line *dl = cur->l;
         
         list_remove(BUFFER_LIST((buffer *)S.current_window->buff), (node *)dl);
+        anchors_remove(&b->anchors, cur->index - 1, prev->len, cur->index, 0, prev);
 
         cur->pos = prev->len;
         line_append_multi(prev, dl->dstr, dl->len);
         
         cur->l = prev;
+        cur->index--;
+
+        // the view began at the joined line, it's the same row of prev now
+        offset *view = &S.current_window->view;
+
+        if(view->l == dl) {
+            view->l = prev;
+            view->index--;
+
+            if(flag_is_on(S.current_window->flags, WINDOW_WRAP)) view->pos += cur->pos;
+        }
 
         line_free(dl);
-    } else {
-        line_remove(cur->l, cur->pos - 1, NULL);
-        cursor_left();
+    } else { // the whole cluster before the cursor
+        buffer_windows_anchor(b, S.current_window);
+
+        int from = line_grapheme_prev(cur->l, cur->pos);
+
+        line_remove_multi(cur->l, from, cur->pos - from, NULL);
+        anchors_remove(&b->anchors, cur->index, from, cur->index, cur->pos, cur->l);
+
+        cur->pos = from;
+        S.current_window->last_col = line_col(cur->l, from);
     }
 
+    buffer_changed(b, cur->l, cur->index, cur->l, cur->index);
+
+    buffer_windows_follow(b, S.current_window);
+
     adjust_view_for_cursor(S.current_window);
 
     pthread_mutex_unlock(&S.current_window->buff->block);
 
-    order_draw_window(S.current_window);
+    order_draw_buffer(b);
+}
+
+// delete count lines from the cursor's one at once, the buffer keeps at least one line.
+// all the windows showing the buffer are moved off the deleted lines
+void current_buffer_delete_lines(int count) {
+    window *cw = S.current_window;
+
+    if(!cw || !cw->buff || count <= 0) return;
+
+    buffer *b = cw->buff;
+
+    pthread_mutex_lock(&b->block);
+
+    buffer_windows_anchor(b, NULL);
+
+    line *first = cw->cur.l, *last = first;
+    int index = cw->cur.index;
+    int n = 1;
+
+    for(; n < count && last->next; n++) {
+        last = last->next;
+    }
+
+    line *target = (last->next) ? last->next : first->prev;
+    int target_index = (last->next) ? index : index - 1; // once the lines are removed
+
+    // the removed text, from the beginning of the first line to the beginning of the
+    // line after the last one, or from the end of the previous line to the end of the last one
+    if(last->next) {
+        anchors_remove(&b->anchors, index, 0, index + n, 0, target);
+    } else if(target) {
+        anchors_remove(&b->anchors, index - 1, target->len, index + n - 1, last->len, target);
+    } else { // all the lines, the first one is kept empty
+        anchors_remove(&b->anchors, 0, 0, n - 1, last->len, first);
+
+        first->len = 0;
+        line_changed(first);
+
+        target = first;
+        target_index = 0;
+        first = first->next;
+    }
+
+    if(first && first->prev != last) {
+        line *after = last->next;
+
+        for(line *l = first; l != after; ) {
+            line *next = l->next;
+
+            list_remove(BUFFER_LIST(b), (node *)l);
+            line_free(l);
+
+            l = next;
+        }
+    }
+
+    buffer_windows_follow(b, NULL);
+
+    buffer_changed(b, target, target_index, target, target_index);
+
+    cw->cur.pos = line_grapheme_start(cw->cur.l, line_pos_in_col(cw->cur.l, cw->last_col));
+    adjust_view_for_cursor(cw);
+
+    pthread_mutex_unlock(&b->block);
+
+    order_draw_buffer(b);
 }
 
 void current_buffer_switch_new() {
@@ -323,7 +485,9 @@ void current_buffer_switch_new() {
 
     nb->draw = (draw_func)draw_window;
 
+    pthread_mutex_lock(&S.highlight_block);
     blist_insert(S.blist, nb);
+    pthread_mutex_unlock(&S.highlight_block);
 
     S.current_window->buff = nb;
     S.current_window->cur = (offset) {
@@ -345,6 +509,9 @@ void current_buffer_inverse_cur_color() {
 
     // buffer *b = S.current_window->buff;
 
+    if(S.current_window->cur.pos >= S.current_window->cur.l->len) return;
+    if(line_own(S.current_window->cur.l)) return;
+
     dchar *dch = &(S.current_window->cur.l->dstr[S.current_window->cur.pos]);
 
     rgb_pair col = dch->color;
@@ -355,6 +522,8 @@ void current_buffer_inverse_cur_color() {
     }
     
     dch->color = RGB_PAIR_INVERSE(col);
+
+    S.current_window->buff->changes++;
 }
 
 void current_buffer_switch_from_file() {
@@ -438,22 +607,28 @@ void current_window_toggle_wrap() {
     if(!S.current_window) return;
     if(!S.current_window->buff) return;
 
-    char to_do = !flag_is_on(S.current_window->flags, WINDOW_WRAP);
+    // view.pos is the horizontal scroll when not wrapping
+    // and the first visual row's position when wrapping
+    pthread_mutex_lock(&S.current_window->buff->block);
 
-    if(to_do) {
+    S.current_window->view.pos = 0;
 
-    } else {
+    S.current_window->flags ^= WINDOW_WRAP;
 
-    }
+    adjust_view_for_cursor(S.current_window);
 
-    S.current_window->flags ^= WINDOW_WRAP;
+    pthread_mutex_unlock(&S.current_window->buff->block);
+
+    order_draw_window(S.current_window);
 }
 
 // split current window in half horizontally
 void new_window_command() {
     logg("New window requested\n");
     window *w = window_empty(L"*empty*");
+    pthread_mutex_lock(&S.highlight_block);
     blist_insert(S.blist, w->buff);
+    pthread_mutex_unlock(&S.highlight_block);
     w->buff->current_window = w;
 
     rect loc = { 0 };
@@ -582,6 +757,451 @@ void window_other_destroy() {
 
 }
 
+// put the buffer's mark at the cursor, it follows the edits from then on
+void mark_set() {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
+    buffer *b = w->buff;
+
+    pthread_mutex_lock(&b->block);
+    anchor_attach(&b->anchors, &b->mark, w->cur.l, w->cur.index, w->cur.pos);
+    pthread_mutex_unlock(&b->block);
+
+    status_set_message(L"| Mark set");
+}
+
+// move the cursor to the mark, the mark is put where the cursor was
+void mark_swap() {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
+    buffer *b = w->buff;
+
+    if(!b->mark.owner) {
+        status_set_message(L"| No mark set");
+        return;
+    }
+
+    pthread_mutex_lock(&b->block);
+
+    line *l = b->mark.l;
+    int index = anchor_index(&b->mark), pos = b->mark.pos;
+
+    anchor_attach(&b->anchors, &b->mark, w->cur.l, w->cur.index, w->cur.pos);
+
+    cursor_set(w, l, index, pos, 0);
+    w->last_col = line_col(l, pos);
+
+    pthread_mutex_unlock(&b->block);
+
+    order_draw_window(w);
+}
+
+// the selection's anchor is in the buffer the selection was begun in
+void _selection_drop(window *w) {
+    anchors *as = w->sel_anchor.owner;
+
+    if(as) {
+        buffer *b = (buffer *)((char *)as - offsetof(buffer, anchors));
+
+        pthread_mutex_lock(&b->block);
+        anchor_detach(&w->sel_anchor);
+        pthread_mutex_unlock(&b->block);
+    }
+
+    w->sel_mode = 0;
+}
+
+// begin a selection of the mode at the cursor, end it if it's already of the mode
+void _selection_toggle(int mode) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
+    if(w->sel_mode == mode) {
+        _selection_drop(w);
+    } else if(w->sel_mode && w->sel_anchor.owner == &w->buff->anchors) {
+        w->sel_mode = mode;
+    } else {
+        _selection_drop(w);
+
+        pthread_mutex_lock(&w->buff->block);
+        anchor_attach(&w->buff->anchors, &w->sel_anchor, w->cur.l, w->cur.index, w->cur.pos);
+        pthread_mutex_unlock(&w->buff->block);
+
+        w->sel_mode = mode;
+    }
+
+    order_draw_window(w);
+}
+
+void selection_toggle() {
+    _selection_toggle(SELECTION_LINEAR);
+}
+
+void selection_toggle_rect() {
+    _selection_toggle(SELECTION_RECT);
+}
+
+// erase what's selected, the kill still shares the erased lines' chars.
+// the windows are moved by the anchors, the cursor is an end of the selection
+void _selection_erase(window *w, buffer *b, offset from, offset to) {
+    if(w->sel_mode == SELECTION_RECT) {
+        line *l = from.l;
+
+        for(int i = from.index; i <= to.index && l; i++, l = l->next) {
+            int a, z;
+
+            if(!window_sel_range(w, l, i, &a, &z) || z <= a) continue;
+
+            line_remove_multi(l, a, z - a, NULL);
+            anchors_remove(&b->anchors, i, a, i, z, l);
+        }
+
+        return;
+    }
+
+    if(from.index == to.index) {
+        line_remove_multi(from.l, from.pos, to.pos - from.pos, NULL);
+    } else {
+        from.l->len = from.pos;
+        line_append_multi(from.l, to.l->dstr + to.pos, to.l->len - to.pos);
+
+        for(line *l = from.l->next; l; ) {
+            line *next = l->next;
+            char is_last = (l == to.l);
+
+            list_remove(BUFFER_LIST(b), (node *)l);
+            line_free(l);
+
+            if(is_last) break;
+
+            l = next;
+        }
+    }
+
+    anchors_remove(&b->anchors, from.index, from.pos, to.index, to.pos, from.l);
+}
+
+// copy the selection to the kill ring, and erase it if erase. the selection is dropped.
+// the copy takes a slice per line without copying the chars, see kill.h
+void _selection_kill(char erase) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
+    buffer *b = w->buff;
+
+    pthread_mutex_lock(&b->block);
+
+    window_sel_take(w, w);
+
+    if(!w->sel_mode) {
+        pthread_mutex_unlock(&b->block);
+        _selection_drop(w);
+        status_set_message(L"| Nothing is selected");
+        return;
+    }
+
+    offset from, to;
+    window_sel_ends(w, &from, &to);
+
+    kill_entry k;
+
+    if(kill_entry_new(&k, to.index - from.index + 1, w->sel_mode == SELECTION_RECT)) {
+        pthread_mutex_unlock(&b->block);
+        status_set_message(L"| Not enough memory to copy");
+        return;
+    }
+
+    line *l = from.l;
+
+    for(int i = from.index; i <= to.index && l; i++, l = l->next) {
+        int a, z;
+
+        if(!window_sel_range(w, l, i, &a, &z) || z < a) a = z = 0; // an empty slice keeps the lines in order
+
+        if(kill_entry_append(&k, l, a, z - a)) {
+            kill_entry_clear(&k);
+            pthread_mutex_unlock(&b->block);
+            status_set_message(L"| Not enough memory to copy");
+            return;
+        }
+    }
+
+    kill_ring_push(S.kills, &k);
+
+    if(erase) {
+        buffer_windows_anchor(b, NULL);
+
+        _selection_erase(w, b, from, to);
+
+        if(w->sel_mode == SELECTION_RECT) {
+            buffer_changed(b, from.l, from.index, to.l, to.index);
+        } else { // joined into the first line
+            buffer_changed(b, from.l, from.index, from.l, from.index);
+        }
+
+        buffer_windows_follow(b, NULL);
+
+        if(w->sel_mode == SELECTION_RECT) { // to the rectangle's left side
+            int lo = (w->sel_cols[0] < w->sel_cols[1]) ? w->sel_cols[0] : w->sel_cols[1];
+            w->cur.pos = line_pos_at_col(w->cur.l, lo);
+        }
+
+        w->last_col = line_col(w->cur.l, w->cur.pos);
+        adjust_view_for_cursor(w);
+    }
+
+    pthread_mutex_unlock(&b->block);
+
+    _selection_drop(w);
+
+    if(erase) {
+        order_draw_buffer(b);
+    } else {
+        order_draw_window(w);
+    }
+
+    status_set_message(L"| %ls %d lines", (erase) ? L"Cut" : L"Copied", k.count);
+}
+
+void selection_copy() {
+    _selection_kill(0);
+}
+
+void selection_cut() {
+    _selection_kill(1);
+}
+
+// the first slice goes into the cursor's line, the others become lines of their own
+// sharing the kill's chars, so that the paste costs O(lines). prompts take the first one only
+int _kill_paste_lines(buffer *b, offset *cur, kill_entry *k) {
+    kill_slice *s = k->slices;
+    line *first = cur->l;
+    int index = cur->index, pos = cur->pos;
+    int n = (flag_is_on(b->flags, BUFFER_PROMPT)) ? 1 : k->count;
+
+    if(n == 1) {
+        if(line_insert_multi(first, kill_slice_dchs(s), s->len, pos)) return -1;
+
+        anchors_insert(&b->anchors, index, pos, 0, first, pos + s->len);
+        cur->pos += s->len;
+
+        return 0;
+    }
+
+    // the rest of the cursor's line goes after the last slice, which is shared if there's no rest
+    kill_slice *ls = s + n - 1;
+    int rest_len = first->len - pos;
+    line *last;
+
+    if(rest_len) {
+        last = line_empty(ls->len + rest_len + 4);
+
+        if(!last) return -1;
+
+        line_append_multi(last, kill_slice_dchs(ls), ls->len);
+        line_append_multi(last, first->dstr + pos, rest_len);
+    } else {
+        last = line_from_chunk(ls->c, ls->off, ls->len);
+
+        if(!last) return -1;
+    }
+
+    first->len = pos;
+    line_insert_multi(first, kill_slice_dchs(s), s->len, pos);
+
+    line *prev = first;
+    int lines = 1;
+
+    for(int i = 1; i < n - 1; i++) {
+        line *l = line_from_chunk(s[i].c, s[i].off, s[i].len);
+
+        if(!l) break;
+
+        list_insert_after(BUFFER_LIST(b), (node *)prev, (node *)l);
+        prev = l;
+        lines++;
+    }
+
+    list_insert_after(BUFFER_LIST(b), (node *)prev, (node *)last);
+
+    anchors_insert(&b->anchors, index, pos, lines, last, ls->len);
+
+    cur->l = last;
+    cur->index = index + lines;
+    cur->pos = ls->len;
+
+    return 0;
+}
+
+// the slices go at the cursor's column of the lines from the cursor's one,
+// shorter lines are padded and missing ones are added
+int _kill_paste_rect(buffer *b, offset *cur, kill_entry *k) {
+    int col = line_col(cur->l, cur->pos);
+    line *l = cur->l;
+
+    for(int i = 0; i < k->count; i++, l = l->next) {
+        kill_slice *s = k->slices + i;
+
+        if(!l) {
+            l = line_empty(col + s->len + 4);
+
+            if(!l) return -1;
+
+            list_insert_after(BUFFER_LIST(b), (node *)b->last, (node *)l);
+        }
+
+        int at = line_pos_at_col(l, col);
+
+        for(int pad = col - line_width(l); pad > 0; pad--) {
+            line_append(l, DCH(L' '));
+            anchors_insert(&b->anchors, cur->index + i, l->len - 1, 0, l, l->len);
+            at = l->len;
+        }
+
+        if(line_insert_multi(l, kill_slice_dchs(s), s->len, at)) return -1;
+
+        anchors_insert(&b->anchors, cur->index + i, at, 0, l, at + s->len);
+    }
+
+    return 0;
+}
+
+// paste the count-th latest kill at the cursor, "p" is the latest one and "3p" is the third
+void kill_paste(int count) {
+    window *w = S.current_window;
+
+    if(!w || !w->buff) return;
+
+    kill_entry *k = kill_ring_get(S.kills, count - 1);
+
+    if(!k || !k->count) {
+        status_set_message(L"| Nothing to paste");
+        return;
+    }
+
+    buffer *b = w->buff;
+    line *first = w->cur.l, *last = first;
+    int index = w->cur.index, n = 1;
+
+    pthread_mutex_lock(&b->block);
+
+    buffer_windows_anchor(b, w);
+
+    int result = (k->is_rect) ? _kill_paste_rect(b, &w->cur, k) : _kill_paste_lines(b, &w->cur, k);
+
+    if(!k->is_rect) {
+        last = w->cur.l;
+        n = w->cur.index - index + 1;
+    } else { // the cursor stays in the first line
+        for(; n < k->count && last->next; n++) last = last->next;
+    }
+
+    buffer_changed(b, first, index, last, index + n - 1);
+
+    buffer_windows_follow(b, w);
+
+    w->last_col = line_col(w->cur.l, w->cur.pos);
+    adjust_view_for_cursor(w);
+
+    pthread_mutex_unlock(&b->block);
+
+    if(result) status_set_message(L"| Not enough memory to paste");
+
+    order_draw_buffer(b);
+}
+
+void macro_toggle_record() {
+    if(S.macro_playing) return;
+
+    if(!S.macro_recording) {
+        S.macro->len = 0;
+        S.macro_recording = 1;
+
+        status_set_message(L"| Recording a macro");
+        return;
+    }
+
+    S.macro_recording = 0;
+    S.macro->len = S.macro_seq_start; // without the keys that stopped it
+
+    status_set_message(L"| Macro of %d keys recorded", S.macro->len);
+}
+
+inline static char _macro_can_play() {
+    if(S.macro_playing) return 0; // a macro replaying itself
+
+    if(S.macro_recording) {
+        status_set_message(L"| Can't replay a macro while recording it");
+        return 0;
+    }
+
+    return S.current_window && S.current_window->buff && S.macro->len;
+}
+
+// replay the macro count times, drawn once at the end
+void macro_play_n(int count) {
+    if(!_macro_can_play()) return;
+
+    S.macro_playing = 1;
+    draw_hold();
+
+    for(int i = 0; i < count; i++) {
+        macro_replay();
+    }
+
+    draw_release();
+    S.macro_playing = 0;
+}
+
+// replay the macro from the beginning of each of count lines from the cursor's one
+void macro_play_lines(int count) {
+    if(!_macro_can_play()) return;
+
+    window *w = S.current_window;
+    int index = w->cur.index;
+
+    S.macro_playing = 1;
+    draw_hold();
+
+    for(int i = 0; i < count && S.current_window == w; i++) {
+        pthread_mutex_lock(&w->buff->block);
+
+        line *l = w->cur.l;
+        int at = w->cur.index;
+
+        while(at < index + i && l->next) {
+            l = l->next;
+            at++;
+        }
+
+        while(at > index + i && l->prev) {
+            l = l->prev;
+            at--;
+        }
+
+        if(at != index + i) { // the buffer has ended
+            pthread_mutex_unlock(&w->buff->block);
+            break;
+        }
+
+        cursor_set(w, l, at, 0, 0);
+        w->last_col = 0;
+
+        pthread_mutex_unlock(&w->buff->block);
+
+        macro_replay();
+    }
+
+    draw_release();
+    S.macro_playing = 0;
+}
+
 // sorry for that
 void _process_edit(wchar_t wch) {
     if(!S.current_window) return;
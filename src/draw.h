@@ -20,6 +20,7 @@
 #define __UNN_DRAW_H_
 
 #include <wchar.h>
+#include <string.h>
 
 #include <notcurses/notcurses.h>
 #include <pthread.h>
@@ -27,42 +28,229 @@
 #include "window.h"
 #include "state.h"
 #include "colors.h"
+#include "highlight.h"
 
-int digits_count(int number) {
-    int d = 1;
+void order_highlight();
+inline static void order_draw_window(window *w);
 
-    number = number / 10;
+long draw_cells = 0; // terminal cells (re)written during the current frame, wide chars and tabs take several
 
-    while(number) {
-        d++;
-        number = number / 10;
+void draw_window_snapshot(window *w);
+
+int draw_grid(struct ncplane *p, grid *g) {
+    if(!g) return -1;
+
+    for(window *w = g->first; w != NULL; w = w->next) {
+        draw_window_snapshot(w);
     }
 
-    return d;
+    return 0;
 }
 
-int draw_grid(struct ncplane *p, grid *g, char blocking) {
-    if(!g) return -1;
+// prepared cells for ASCII glyphs in a given style,
+// direct-mapped so that lookups stay cheap
+#define CELL_CACHE_SIZE 64
 
-    for(window *w = g->first; w != NULL; w = w->next) {
-        if(blocking) {
-            pthread_mutex_lock(&w->buff->block);
-        } else {
-            if(pthread_mutex_trylock(&w->buff->block)) continue;
+typedef struct cell_cache_entry {
+    char used;
+    wchar_t wch;
+    rgb_pair col;
+    nccell c;
+} cell_cache_entry;
+
+cell_cache_entry cell_cache[CELL_CACHE_SIZE] = { 0 };
+
+inline static char rgb_pair_eq(rgb_pair a, rgb_pair b) {
+    return a.fg.r == b.fg.r && a.fg.g == b.fg.g && a.fg.b == b.fg.b &&
+        a.bg.r == b.bg.r && a.bg.g == b.bg.g && a.bg.b == b.bg.b;
+}
+
+// only ASCII cells are cached, they're stored inline and don't depend on the plane's pool
+inline static nccell *cell_cache_get(wchar_t wch, rgb_pair col) {
+    if(wch < 0x20 || wch > 0x7e) return NULL;
+
+    unsigned idx = (wch * 31 + col.fg.r + col.fg.g * 3 + col.fg.b * 5 +
+        col.bg.r * 7 + col.bg.g * 11 + col.bg.b * 13) % CELL_CACHE_SIZE;
+
+    cell_cache_entry *ce = cell_cache + idx;
+
+    if(ce->used && ce->wch == wch && rgb_pair_eq(ce->col, col)) {
+        return &ce->c;
+    }
+
+    ce->used = 1;
+    ce->wch = wch;
+    ce->col = col;
+    ce->c = (nccell) NCCELL_TRIVIAL_INITIALIZER;
+
+    nccell_set_bg_rgb8(&ce->c, col.bg.r, col.bg.g, col.bg.b);
+    nccell_set_fg_rgb8(&ce->c, col.fg.r, col.fg.g, col.fg.b);
+    nccell_load_ucs32(S.p, &ce->c, wch);
+
+    return &ce->c;
+}
+
+const wchar_t SPACES[] = L"                                                                ";
+
+// uses the plane's current colors
+inline static void empty_at_yx(int y, int x, int amount) {
+    const int spaces_len = sizeof(SPACES) / sizeof(*SPACES) - 1;
+
+    if(amount > 0) draw_cells += amount;
+
+    while(amount > 0) {
+        int n = (amount > spaces_len) ? spaces_len : amount;
+
+        ncplane_putwstr_yx(S.p, y, x, SPACES + spaces_len - n);
+
+        x += n;
+        amount -= n;
+    }
+}
+
+inline static void blank_at_yx(int y, int x, int amount, rgb_pair col) {
+    if(amount <= 0) return;
+
+    draw_cells += amount;
+
+    ncplane_cursor_move_yx(S.p, y, x);
+    ncplane_hline(S.p, cell_cache_get(L' ', col), amount);
+}
+
+inline static void dchar_put_yx(dchar dch, int y, int x, rgb_pair col) {
+    if(flag_is_on(dch.flags, DCHAR_COLORED)) {
+        col = dch.color;
+    } else if(flag_is_on(dch.flags, DCHAR_SYNTAX)) {
+        col.fg = dch.color.fg;
+    }
+
+    draw_cells += wch_width(dch.wch);
+
+    nccell *cached = cell_cache_get(dch.wch, col);
+
+    if(cached) {
+        ncplane_putc_yx(S.p, y, x, cached);
+        return;
+    }
+
+    nccell c = { 0 };
+
+    nccell_set_bg_rgb8(&c, col.bg.r, col.bg.g, col.bg.b);
+    nccell_set_fg_rgb8(&c, col.fg.r, col.fg.g, col.fg.b);
+
+    nccell_load_ucs32(S.p, &c, dch.wch);
+
+    ncplane_putc_yx(S.p, y, x, &c);
+
+    nccell_release(S.p, &c);
+}
+
+inline static unsigned dchar_styles(int flags) {
+    unsigned st = NCSTYLE_NONE;
+
+    if(flag_is_on(flags, DCHAR_BOLD)) st |= NCSTYLE_BOLD;
+    if(flag_is_on(flags, DCHAR_ITALIC)) st |= NCSTYLE_ITALIC;
+
+    return st;
+}
+
+// split dstr into runs of identically styled chars,
+// each run sets the plane's style once and is put with a single call.
+// line_col is the line's column dstr begins at, tabs are expanded to spaces up to their tab stop
+inline static void dstr_put_yx(dchar *dstr, int y, int x, int amount, int line_col, rgb_pair col) {
+    if(!dstr) return;
+
+    wchar_t run[256];
+    int run_len = 0;
+    int run_cols = 0;
+    int run_x = x;
+
+    rgb_pair run_col = col;
+    unsigned run_st = NCSTYLE_NONE;
+
+    for(int i = 0; i <= amount; i++) {
+        rgb_pair c = col;
+        unsigned st = NCSTYLE_NONE;
+
+        if(i < amount) {
+            if(flag_is_on(dstr[i].flags, DCHAR_COLORED)) {
+                c = dstr[i].color;
+            } else if(flag_is_on(dstr[i].flags, DCHAR_SYNTAX)) {
+                c.fg = dstr[i].color.fg;
+            }
+            st = dchar_styles(dstr[i].flags);
+        }
+
+        char flush = (i == amount) || (run_len >= sizeof(run) / sizeof(*run) - LINE_TAB_WIDTH - 1) ||
+            (run_len && (st != run_st || !rgb_pair_eq(c, run_col)));
+
+        if(flush && run_len) {
+            run[run_len] = 0;
+
+            ncplane_set_bg_rgb8(S.p, run_col.bg.r, run_col.bg.g, run_col.bg.b);
+            ncplane_set_fg_rgb8(S.p, run_col.fg.r, run_col.fg.g, run_col.fg.b);
+            ncplane_set_styles(S.p, run_st);
+
+            ncplane_putwstr_yx(S.p, y, run_x, run);
+
+            draw_cells += run_cols;
+            run_x += run_cols;
+            run_len = 0;
+            run_cols = 0;
         }
 
-        buffer *b = w->buff;
-        if(b) {
-            draw_func draw = b->draw;
-            if(draw) {
-                draw(w);
+        if(i == amount) break;
+
+        run_col = c;
+        run_st = st;
+
+        wchar_t wch = dstr[i].wch;
+        int width = line_wch_width(wch, line_col);
+
+        if(wch == L'\t') {
+            for(int j = 0; j < width; j++) {
+                run[run_len++] = L' ';
             }
+        } else {
+            run[run_len++] = (wch) ? wch : L' ';
         }
 
-        pthread_mutex_unlock(&w->buff->block);
+        run_cols += width;
+        line_col += width;
     }
 
-    return 0;
+    ncplane_set_styles(S.p, NCSTYLE_NONE);
+}
+
+// status line is split into segments, each one is formatted and drawn
+// only when it's source values change (or when a segment before it changes it's length)
+#define STATUS_SEG_BUFFER 0
+#define STATUS_SEG_MODE 1
+#define STATUS_SEG_INPUT 2
+#define STATUS_SEG_MESSAGE 3
+#define STATUS_SEGS 4
+
+typedef struct status_cache {
+    char valid; // 0 if the whole status row must be redrawn
+    int y, width;
+    int end; // x after the last drawn segment
+
+    // source values
+    int buff_index;
+    wchar_t buff_name[256];
+    char is_edit;
+    char input[32];
+    wchar_t message[512];
+
+    // formatted segments
+    wchar_t segs[STATUS_SEGS][512];
+    int lens[STATUS_SEGS];
+} status_cache;
+
+status_cache SC = { 0 };
+
+inline static void status_invalidate() {
+    SC.valid = 0;
 }
 
 int draw_status(struct ncplane *p) {
@@ -77,88 +265,371 @@ int draw_status(struct ncplane *p) {
     ncplane_set_fg_rgb8(S.p, S.colors_status.fg.r, S.colors_status.fg.g, S.colors_status.fg.b);
     ncplane_set_bg_rgb8(S.p, S.colors_status.bg.r, S.colors_status.bg.g, S.colors_status.bg.b);
 
-    logg("%d %d %d\n", S.colors_status.fg.r, S.colors_status.fg.g, S.colors_status.fg.b);
-
-    for(int i = 0; i < max_x; i++) {
-        ncplane_putchar_yx(S.p, y, x + i, ' ');
+    if(SC.y != y || SC.width != max_x) {
+        SC.valid = 0;
     }
 
-    wchar_t buffer[512] = { 0 };
+    char dirty[STATUS_SEGS] = { 0 };
 
-    wchar_t *msg = L"";
+    int old_lens[STATUS_SEGS];
+    memcpy(old_lens, SC.lens, sizeof(old_lens));
 
-    char locked = 0;
+    // buffer
+    int buff_index = -1;
+    wchar_t *buff_name = L"*NO WINDOW*";
+
+    if(S.current_window) {
+        if(S.current_window->buff) {
+            buff_index = S.current_window->buff->index;
+            buff_name = S.current_window->buff->name;
+        } else {
+            buff_name = L"*NO BUFFER*";
+        }
+    }
+
+    if(!SC.valid || SC.buff_index != buff_index || wcsncmp(SC.buff_name, buff_name, 255)) {
+        SC.buff_index = buff_index;
+        wcsncpy(SC.buff_name, buff_name, 255);
+
+        SC.lens[STATUS_SEG_BUFFER] = swprintf(SC.segs[STATUS_SEG_BUFFER], 511,
+            L"unn <[%d]%ls> ", buff_index, buff_name);
+        dirty[STATUS_SEG_BUFFER] = 1;
+    }
 
-    if(!pthread_mutex_trylock(&S.status_message_block)) {
-        locked = 1;
-        msg = S.status_message;
-    }
-
-    swprintf(buffer, sizeof(buffer) - 1, 
-    L"unn <[%d]%ls> %s [%s] %ls",
-    // buffer index
-    ((S.current_window) ?
-        (((S.current_window->buff) ?
-            S.current_window->buff->index : 
-            -1)) : 
-        -1),
-    // buffer name
-    ((S.current_window) ?
-        (((S.current_window->buff) ?
-            S.current_window->buff->name : 
-            L"*NO BUFFER*")) : 
-        L"*NO WINDOW*"),
     // mode
-    (flag_is_on(S.flags, FLAG_EDIT) ?
-        "EDIT" : 
-        "MOVE"),
+    char is_edit = !!flag_is_on(S.flags, FLAG_EDIT);
+
+    if(!SC.valid || SC.is_edit != is_edit) {
+        SC.is_edit = is_edit;
+
+        SC.lens[STATUS_SEG_MODE] = swprintf(SC.segs[STATUS_SEG_MODE], 511,
+            L"%s ", (is_edit) ? "EDIT" : "MOVE");
+        dirty[STATUS_SEG_MODE] = 1;
+    }
+
     // input
-    S.input_buffer,
-    // message
-    msg);
-    
-    if(locked) {
+    if(!SC.valid || strncmp(SC.input, S.input_buffer, sizeof(SC.input) - 1)) {
+        strncpy(SC.input, S.input_buffer, sizeof(SC.input) - 1);
+
+        SC.lens[STATUS_SEG_INPUT] = swprintf(SC.segs[STATUS_SEG_INPUT], 511,
+            L"[%s] ", SC.input);
+        dirty[STATUS_SEG_INPUT] = 1;
+    }
+
+    // message, if it's being edited now the cached one is kept
+    if(!pthread_mutex_trylock(&S.status_message_block)) {
+        if(!SC.valid || wcsncmp(SC.message, S.status_message, 511)) {
+            wcsncpy(SC.message, S.status_message, 511);
+
+            SC.lens[STATUS_SEG_MESSAGE] = swprintf(SC.segs[STATUS_SEG_MESSAGE], 511,
+                L"%ls", SC.message);
+            dirty[STATUS_SEG_MESSAGE] = 1;
+        }
+
         pthread_mutex_unlock(&S.status_message_block);
+    } else if(!SC.valid) {
+        SC.message[0] = 0;
+        SC.segs[STATUS_SEG_MESSAGE][0] = 0;
+        SC.lens[STATUS_SEG_MESSAGE] = 0;
+        dirty[STATUS_SEG_MESSAGE] = 1;
+    }
+
+    if(!SC.valid) {
+        empty_at_yx(y, x, max_x);
+        SC.end = 0;
+    }
+
+    char shifted = 0;
+
+    for(int i = 0; i < STATUS_SEGS; i++) {
+        if(SC.lens[i] < 0) { // didn't fit
+            SC.segs[i][0] = 0;
+            SC.lens[i] = 0;
+        }
+
+        if(dirty[i] || shifted) {
+            ncplane_putwstr_yx(p, y, x, SC.segs[i]);
+            draw_cells += wcs_width(SC.segs[i], SC.lens[i]);
+        }
+
+        // segments after the one that changed it's length are moved
+        if(dirty[i] && SC.lens[i] != old_lens[i]) shifted = 1;
+
+        x += SC.lens[i];
+    }
+
+    if(x < SC.end) {
+        empty_at_yx(y, x, SC.end - x);
     }
 
-    ncplane_putwstr_yx(p, y, x, buffer);
+    SC.end = x;
+    SC.y = y;
+    SC.width = max_x;
+    SC.valid = 1;
 
     return 0;
 }
 
-inline static void empty_at_yx(int y, int x, int amount) {
-    int last_x = amount + x;
+inline static void window_drawn_invalidate(window *w) {
+    if(!w) return;
+    w->drawn.valid = 0;
+}
+
+// parameters of a single draw_window call shared by it's row drawing functions
+typedef struct window_draw_ctx {
+    window *w;
+    colors cl;
+    int dc;
+    int left_border, right_border;
+    char is_marked;
+    char gutter_valid; // w->gutter matches what's on the plane
+} window_draw_ctx;
+
+// line number right-aligned in dc cells (or GUTTER_* filler), followed by a space,
+// drawn only if the row doesn't already show it
+inline static void draw_window_gutter(window_draw_ctx *ctx, int y, int number) {
+    window *w = ctx->w;
+    int row = y - w->pos.y1;
+
+    char cached = w->gutter && row < w->gutter_len;
+
+    if(cached) {
+        if(ctx->gutter_valid && w->gutter[row] == number) return;
+
+        w->gutter[row] = number;
+    }
+
+    char buff[32];
+    int dc = ctx->dc;
+
+    buff[dc] = ' ';
+    buff[dc + 1] = 0;
+
+    int i = dc - 1;
 
-    for(; x < last_x; x++) {
-        ncplane_putwc_yx(S.p, y, x, L' ');
+    if(number > 0) {
+        for(; number && i >= 0; i--) {
+            buff[i] = '0' + number % 10;
+            number /= 10;
+        }
+
+        for(; i >= 0; i--) buff[i] = ' ';
+    } else {
+        char filler = (number == GUTTER_WRAPPED) ? ' ' : '-';
+        for(; i >= 0; i--) buff[i] = filler;
     }
+
+    ncplane_putstr_yx(S.p, y, w->pos.x1, buff);
+    draw_cells += dc + 1;
 }
 
-inline static void dchar_put_yx(dchar dch, int y, int x, rgb_pair col) {
-    nccell c = { 0 };
+// make w->gutter fit the window's height, reset it if it can't be trusted
+inline static void window_gutter_prepare(window_draw_ctx *ctx, int height) {
+    window *w = ctx->w;
 
-    if(flag_is_on(dch.flags, DCHAR_COLORED)) {
-        col = dch.color;
+    if(w->gutter_len != height) {
+        int *gutter = (int *)realloc(w->gutter, sizeof(*gutter) * height);
+
+        if(!gutter) { // gutter is drawn uncached then
+            free(w->gutter);
+            w->gutter = NULL;
+            w->gutter_len = 0;
+            return;
+        }
+
+        w->gutter = gutter;
+        w->gutter_len = height;
+        ctx->gutter_valid = 0;
     }
 
-    nccell_set_bg_rgb8(&c, col.bg.r, col.bg.g, col.bg.b);
-    nccell_set_fg_rgb8(&c, col.fg.r, col.fg.g, col.fg.b);
+    if(!ctx->gutter_valid) {
+        for(int i = 0; i < height; i++) {
+            w->gutter[i] = GUTTER_UNKNOWN;
+        }
+    }
+}
 
-    nccell_load_ucs32(S.p, &c, dch.wch);
+// selected chars shown from shown_from up to shown_to are drawn over with inverted colors
+inline static void draw_window_selected(window_draw_ctx *ctx, line *l, int index, int y,
+    int shown_from, int shown_to, int base, rgb_pair col) {
+    int from, to;
 
-    ncplane_putc_yx(S.p, y, x, &c);
+    if(!window_sel_range(ctx->w, l, index, &from, &to)) return;
+
+    if(from < shown_from) from = shown_from;
+    if(to > shown_to) to = shown_to;
+
+    if(to <= from) return;
+
+    int c = line_col(l, from);
+
+    dstr_put_yx(l->dstr + from, y, ctx->left_border + c - base, to - from, c, RGB_PAIR_INVERSE(col));
 }
 
-inline static void dstr_put_yx(dchar *dstr, int y, int x, int amount, rgb_pair col) {
-    if(!dstr) return;
+inline static void draw_window_line(window_draw_ctx *ctx, line *l, int index, int y) {
+    window *w = ctx->w;
+    colors *cl = &ctx->cl;
 
-    ncplane_cursor_move_yx(S.p, y, x);
+    int dc = ctx->dc;
+    int left_border = ctx->left_border;
+    int right_border = ctx->right_border;
+
+    char is_cur = (l == w->cur.l);
+    rgb_pair col = (is_cur) ? cl->cur_line : cl->gen;
+
+    // print line numbers
+    if(dc) {
+        draw_window_gutter(ctx, y, index + 1);
+    }
+
+    // print decorated text
+    // with account for right border
+
+    int withhold = 0;
+    int printed = 0; // cells
+    int base = line_col(l, w->view.pos);
+
+    if(w->view.pos < l->len) {
+        int end = line_pos_fit(l, w->view.pos, right_border - left_border + 1);
+
+        withhold = l->len - end;
+        printed = line_col(l, end) - base;
+
+        dstr_put_yx(l->dstr + w->view.pos, y, left_border, end - w->view.pos, base, col);
+        draw_window_selected(ctx, l, index, y, w->view.pos, end, base, col);
+    }
+
+    // clear the rest of the row up to the window's border
+    blank_at_yx(y, left_border + printed, w->pos.x2 - left_border - printed + 1, col);
+
+    ncplane_set_bg_rgb8(S.p, cl->gen.bg.r, cl->gen.bg.g, cl->gen.bg.b);
+    ncplane_set_fg_rgb8(S.p, cl->gen.fg.r, cl->gen.fg.g, cl->gen.fg.b);
+
+    if(is_cur && (w->view.pos <= w->cur.pos)) {
+        wchar_t ch = (w->cur.pos < l->len) ? l->dstr[w->cur.pos].wch : L' ';
+        if(ch == L'\t') ch = L' '; // cursor takes the tab's first cell
+        dchar_put_yx((dchar) { .wch = ch,
+                               .flags = 0,
+         }, y, left_border + line_col(l, w->cur.pos) - base, cl->cur);
+    }
+
+    if(ctx->is_marked) {
+        if(withhold) {
+            dchar_put_yx(DCH(L'>'), y, w->pos.x2, cl->cur);
+        }
+    }
+}
+
+// draw a row below the buffer's last line
+inline static void draw_window_empty(window_draw_ctx *ctx, int y) {
+    window *w = ctx->w;
+
+    if(ctx->dc) {
+        draw_window_gutter(ctx, y, GUTTER_EMPTY);
+    }
+
+    empty_at_yx(y, ctx->left_border, w->pos.x2 - ctx->left_border + 1);
+}
+
+// draw the window's row, row is relative to the view
+inline static void draw_window_row(window_draw_ctx *ctx, int row) {
+    window *w = ctx->w;
+
+    line *l = w->view.l;
+    for(int i = 0; l && i < row; i++) {
+        l = l->next;
+    }
+
+    if(l) {
+        draw_window_line(ctx, l, w->view.index + row, w->pos.y1 + row);
+    } else {
+        draw_window_empty(ctx, w->pos.y1 + row);
+    }
+}
+
+// draw a visual row of a wrapped line
+inline static void draw_window_wrapped_row(window_draw_ctx *ctx, wrap_row *r, int tw, int y) {
+    window *w = ctx->w;
+    colors *cl = &ctx->cl;
+    line *l = r->l;
+
+    char is_cur = (l == w->cur.l);
+    rgb_pair col = (is_cur) ? cl->cur_line : cl->gen;
+
+    if(ctx->dc) {
+        draw_window_gutter(ctx, y, (r->pos) ? GUTTER_WRAPPED : r->index + 1);
+    }
+
+    // a char crossing the row's end begins the next row, see line_row_next
+    int base = line_col(l, r->pos);
+    int next = line_row_next(l, tw, r->pos);
+    int end = (next < 0) ? l->len : next;
+    int printed = line_col(l, end) - base;
+
+    if(printed > tw) { // a single char wider than the whole row
+        end = r->pos;
+        printed = 0;
+    }
+
+    if(end > r->pos) {
+        dstr_put_yx(l->dstr + r->pos, y, ctx->left_border, end - r->pos, base, col);
+        draw_window_selected(ctx, l, r->index, y, r->pos, end, base, col);
+    }
+
+    blank_at_yx(y, ctx->left_border + printed, w->pos.x2 - ctx->left_border - printed + 1, col);
+
+    ncplane_set_bg_rgb8(S.p, cl->gen.bg.r, cl->gen.bg.g, cl->gen.bg.b);
+    ncplane_set_fg_rgb8(S.p, cl->gen.fg.r, cl->gen.fg.g, cl->gen.fg.b);
+
+    if(is_cur && w->cur.pos >= r->pos && line_pos_row(l, tw, w->cur.pos) == r->row) {
+        wchar_t ch = (w->cur.pos < l->len) ? l->dstr[w->cur.pos].wch : L' ';
+        if(ch == L'\t') ch = L' '; // cursor takes the tab's first cell
+        dchar_put_yx((dchar) { .wch = ch,
+                               .flags = 0,
+         }, y, ctx->left_border + line_col(l, w->cur.pos) - base, cl->cur);
+    }
+}
+
+inline static void draw_window_wrapped(window_draw_ctx *ctx, int height) {
+    window *w = ctx->w;
+
+    int tw = ctx->right_border - ctx->left_border + 1;
+    if(tw < 1) tw = 1;
 
-    for(int i = 0; i < amount; i++) {
-        dchar_put_yx(dstr[i], y, x + i, col);
+    wrap_row *map = window_wrap_map(w, tw, height);
+
+    for(int row = 0; row < height; row++) {
+        int y = w->pos.y1 + row;
+
+        if(map && map[row].l) {
+            draw_window_wrapped_row(ctx, map + row, tw, y);
+        } else {
+            draw_window_empty(ctx, y);
+        }
     }
 }
 
+// check if the window's contents on the plane can be reused, so that only the cursor rows
+// need to be redrawn. a scrolled view is repainted: notcurses already writes only the cells
+// that changed, and copying the plane's cells costs more than drawing the rows again
+inline static char draw_window_is_lazy(window *w, window_draw_ctx *ctx, char is_focused) {
+    window_drawn *d = &w->drawn;
+
+    if(!d->valid) return 0;
+    if(flag_is_on(w->flags, WINDOW_WRAP)) return 0; // rows don't map to lines 1:1
+    if(d->buff != w->buff) return 0;
+    if(d->changes != w->buff->changes) return 0;
+    if(d->hl_changes != w->buff->hl_changes) return 0;
+    if(d->sel_mode || w->sel_mode) return 0; // the selection's rows aren't tracked
+    if(d->focused != is_focused) return 0;
+    if(d->flags != w->flags) return 0;
+    if(d->dc != ctx->dc) return 0;
+    if(d->view.pos != w->view.pos) return 0;
+    if(memcmp(&d->pos, &w->pos, sizeof(d->pos))) return 0;
+
+    return d->view.index == w->view.index;
+}
+
 void draw_window(window *w) {
     if(!w) return;
     if(!w->buff) return;
@@ -166,118 +637,220 @@ void draw_window(window *w) {
     // buffer *b = w->buff;
 
     char is_focused = (S.current_window == w);
-    char is_numbered = flag_is_on(S.current_window->flags, WINDOW_LINES);
-    char is_marked = !!flag_is_on(S.current_window->flags, WINDOW_LONG_MARKS);
+    char is_numbered = flag_is_on(w->flags, WINDOW_LINES);
 
-    colors cl = (is_focused) ? w->cl.focused : w->cl.unfocused;
+    window_draw_ctx ctx = {
+        .w = w,
+        .cl = (is_focused) ? w->cl.focused : w->cl.unfocused,
+        .is_marked = !!flag_is_on(w->flags, WINDOW_LONG_MARKS),
+    };
+
+    colors cl = ctx.cl;
 
     ncplane_set_bg_rgb8(S.p, cl.gen.bg.r, cl.gen.bg.g, cl.gen.bg.b);
     ncplane_set_fg_rgb8(S.p, cl.gen.fg.r, cl.gen.fg.g, cl.gen.fg.b);
 
     int height = w->pos.y2 - w->pos.y1 + 1;
-    int width = w->pos.x2 - w->pos.x1 + 1;
 
-    int dc = 0;
-    int left_border = w->pos.x1;
-    int right_border = w->pos.x2;
+    ctx.left_border = w->pos.x1;
+    ctx.right_border = w->pos.x2;
 
     if(is_numbered) {
-        dc = digits_count(w->view.index + height + 1);
-        left_border += dc + 1;
-        w->dc = dc;
-    } else {
-        w->dc = 0;
+        ctx.dc = window_dc(w);
+        ctx.left_border += ctx.dc + 1;
     }
 
-    if(is_marked) {
-        right_border -= 1;
+    w->dc = ctx.dc;
+
+    if(ctx.is_marked) {
+        ctx.right_border -= 1;
     }
 
-    int current_line_y = w->pos.y1;
-    int last_line_y = w->pos.y2;
+    if(ctx.dc) {
+        window_drawn *d = &w->drawn;
 
-    line *current_line = w->view.l;
+        ctx.gutter_valid = d->valid && d->dc == ctx.dc && d->focused == is_focused &&
+            !memcmp(&d->pos, &w->pos, sizeof(d->pos));
 
-    char buff[32] = { 0 };
+        window_gutter_prepare(&ctx, height);
+    }
 
-    // draw existing lines
-    for(; current_line_y <= last_line_y; current_line_y++) {
-        if(!current_line) break;
+    if(flag_is_on(w->flags, WINDOW_WRAP)) {
+        draw_window_wrapped(&ctx, height);
+    } else if(draw_window_is_lazy(w, &ctx, is_focused)) {
+        window_drawn *d = &w->drawn;
 
-        // print line numbers
-        if(dc) {
-            int indent = dc - snprintf(buff, sizeof(buff) - 1, "%d", w->view.index + 1 + current_line_y - w->pos.y1);
-            empty_at_yx(current_line_y, w->pos.x1, indent);
-            ncplane_putstr_yx(S.p, current_line_y, w->pos.x1 + indent, buff);
-            ncplane_putwc_yx(S.p, current_line_y, w->pos.x1 + dc, L' ');
-            buff[0] = 0;
+        // the previous cursor line loses it's highlighting
+        int old_row = d->cur.index - w->view.index;
+        if(old_row >= 0 && old_row < height) {
+            draw_window_row(&ctx, old_row);
         }
 
-        // print decorated text
-        // with account for right border
+        int new_row = w->cur.index - w->view.index;
+        if(new_row != old_row && new_row >= 0 && new_row < height) {
+            draw_window_row(&ctx, new_row);
+        }
+    } else {
+        int current_line_y = w->pos.y1;
+        int last_line_y = w->pos.y2;
 
-        int line_length = current_line->len - S.current_window->view.pos;
-        int withhold = 0;
-        int to_be_printed = 0;
-        int line_right_border = left_border + line_length;
+        line *current_line = w->view.l;
 
-        if(line_length > 0) {
-            if(line_right_border > right_border) {
-                withhold = line_right_border - right_border - 1;
-            }
+        // draw existing lines
+        for(; current_line_y <= last_line_y; current_line_y++) {
+            if(!current_line) break;
 
-            to_be_printed = line_length - withhold;
+            draw_window_line(&ctx, current_line,
+                w->view.index + current_line_y - w->pos.y1, current_line_y);
 
-            dstr_put_yx(current_line->dstr + w->view.pos, current_line_y, left_border, to_be_printed,
-                (current_line == w->cur.l) ? cl.cur_line : cl.gen);
+            current_line = current_line->next;
         }
 
-        if(current_line == w->cur.l) {
-            if(line_right_border <= right_border) {
-                ncplane_set_bg_rgb8(S.p, cl.cur_line.bg.r, cl.cur_line.bg.g, cl.cur_line.bg.b);
-                ncplane_set_fg_rgb8(S.p, cl.cur_line.fg.r, cl.cur_line.fg.g, cl.cur_line.fg.b);
+        // draw empty space
+        for(; current_line_y <= last_line_y; current_line_y++) {
+            draw_window_empty(&ctx, current_line_y);
+        }
+    }
 
-                empty_at_yx(current_line_y, left_border + to_be_printed, right_border - to_be_printed);
+    w->drawn = (window_drawn) {
+        .valid = 1,
+        .focused = is_focused,
+        .flags = w->flags,
+        .dc = ctx.dc,
+        .changes = w->buff->changes,
+        .hl_changes = w->buff->hl_changes,
+        .sel_mode = w->sel_mode,
+        .buff = w->buff,
+        .pos = w->pos,
+        .view = w->view,
+        .cur = w->cur,
+    };
+}
 
-                ncplane_set_bg_rgb8(S.p, cl.gen.bg.r, cl.gen.bg.g, cl.gen.bg.b);
-                ncplane_set_fg_rgb8(S.p, cl.gen.fg.r, cl.gen.fg.g, cl.gen.fg.b);
-            }
+// copy the shown lines and the buffer's state into the window's snapshot,
+// the buffer's block is only held while copying. returns the number of copied lines
+int _window_snapshot_take(window *w, buffer *b, window *tmp, buffer *sb) {
+    int height = w->pos.y2 - w->pos.y1 + 1;
 
-            if(w->view.pos <= w->cur.pos) {
-                wchar_t ch = (current_line->len) ? (
-                    (w->cur.pos < current_line->len) ? current_line->dstr[w->cur.pos].wch : L' '
-                ) : L' ';
-                dchar_put_yx((dchar) { .wch = ch, 
-                                       .flags = 0,
-                 }, current_line_y, w->cur.pos + left_border - w->view.pos, cl.cur);
-            }
+    *tmp = *w;
+
+    // only what the drawing reads, the block and the anchors stay with the buffer
+    *sb = (buffer) {
+        .draw = b->draw,
+        .lines_count = b->lines_count,
+        .name = b->name,
+        .index = b->index,
+        .flags = b->flags,
+        .changes = b->changes,
+        .syn = b->syn,
+        .hl_changes = b->hl_changes,
+    };
+
+    window_sel_take(w, tmp);
+
+    // shown lines are highlighted in the background before the others
+    if(highlight_view_record(b, w, w->view.l, w->view.index, height)) {
+        order_highlight();
+    }
+
+    if(height > w->snap_cap) {
+        line *snap = (line *)realloc(w->snap, sizeof(*snap) * height);
+
+        if(!snap) {
+            height = w->snap_cap;
         } else {
-            if(line_right_border < right_border) {
-                empty_at_yx(current_line_y, left_border + to_be_printed, right_border - to_be_printed);
-            }
-        }
+            memset(snap + w->snap_cap, 0, sizeof(*snap) * (height - w->snap_cap));
 
-        if(is_marked) {
-            if(withhold) {
-                dchar_put_yx(DCH(L'>'),
-                    current_line_y, w->pos.x2, cl.cur);
-            }
+            w->snap = snap;
+            w->snap_cap = height;
         }
+    }
+
+    int count = 0;
+    tmp->cur.l = NULL; // unless it's shown
 
-        current_line = current_line->next;
+    for(line *l = w->view.l; l && count < height; l = l->next, count++) {
+        line *c = w->snap + count;
+
+        if(line_copy_to(c, l)) break;
+
+        c->prev = (count) ? c - 1 : NULL;
+        c->next = NULL;
+        if(count) c[-1].next = c;
+
+        if(l == w->cur.l) tmp->cur.l = c;
     }
 
-    // draw empty space
-    for(; current_line_y <= last_line_y; current_line_y++) {
-        empty_at_yx(current_line_y, w->pos.x1, width);
+    tmp->view.l = (count) ? w->snap : NULL;
 
-        if(dc) {
-            for(int i = 0; i < dc; i++) {
-                ncplane_putwc_yx(S.p, current_line_y, w->pos.x1 + i, L'-');
-            }
-            ncplane_putwc_yx(S.p, current_line_y, w->pos.x1 + dc, L' ');
+    return count;
+}
+
+#define DRAW_BUSY_MAX 3
+
+// draw the window from a snapshot of what it shows,
+// so that edits never wait for drawing and drawing never skips a window
+void draw_window_snapshot(window *w) {
+    if(!w) return;
+
+    buffer *b = w->buff;
+    if(!b) return;
+
+    window tmp;
+    buffer sb;
+
+    // an edit or a highlighting step holds the block for a moment, the drawing doesn't
+    // wait for it and the window is drawn in the next frame. after DRAW_BUSY_MAX such frames
+    // the drawing waits, so a long edit or no frame budget doesn't make the draw loop spin
+    if(pthread_mutex_trylock(&b->block)) {
+        if(w->draw_busy < DRAW_BUSY_MAX) {
+            w->draw_busy++;
+            order_draw_window(w);
+            return;
         }
+
+        pthread_mutex_lock(&b->block);
+    }
+
+    w->draw_busy = 0;
+
+    if(w->buff != b) { // switched meanwhile
+        pthread_mutex_unlock(&b->block);
+        order_draw_window(w);
+        return;
     }
+
+    _window_snapshot_take(w, b, &tmp, &sb);
+
+    pthread_mutex_unlock(&b->block);
+
+    tmp.buff = &sb;
+
+    if(tmp.drawn.buff == b) tmp.drawn.buff = &sb;
+
+    // the map points to the snapshot's lines. they were copied again, but they are the same
+    // while the buffer's changes and the view are, see window_wrap_map
+
+    draw_func draw = sb.draw;
+    if(draw) {
+        draw(&tmp);
+    } else {
+        draw_window(&tmp);
+    }
+
+    // take back what the drawing has updated
+    w->dc = tmp.dc;
+    w->drawn = tmp.drawn;
+    if(w->drawn.buff == &sb) w->drawn.buff = b;
+
+    w->gutter = tmp.gutter;
+    w->gutter_len = tmp.gutter_len;
+
+    w->wrap_map = tmp.wrap_map;
+    w->wrap_map_len = tmp.wrap_map_len;
+    w->wrap_width = tmp.wrap_width;
+    w->wrap_changes = tmp.wrap_changes;
+    w->wrap_view = tmp.wrap_view;
 }
 
-#endif
\ No newline at end of file
+#endif
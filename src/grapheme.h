@@ -0,0 +1,181 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_GRAPHEME_H_
+#define __UNN_GRAPHEME_H_
+
+#include <wchar.h>
+
+#include "width.h"
+
+// grapheme cluster boundaries, a compact subset of UAX #29: the properties of the
+// rules are compiled in as ranges, except Extend which is mostly taken from
+// the width table (zero width non-controls), since it's the bulk of the ranges
+
+#define GCB_OTHER 0
+#define GCB_CR 1
+#define GCB_LF 2
+#define GCB_CONTROL 3
+#define GCB_EXTEND 4
+#define GCB_ZWJ 5
+#define GCB_RI 6 // regional indicator, flags are pairs of them
+#define GCB_PREPEND 7
+#define GCB_SPACING 8 // spacing mark
+#define GCB_L 9 // hangul jamo
+#define GCB_V 10
+#define GCB_T 11
+#define GCB_LV 12
+#define GCB_LVT 13
+#define GCB_PICT 14 // extended pictographic
+
+typedef struct gcb_range {
+    wchar_t from, to;
+    unsigned char prop;
+} gcb_range;
+
+// sorted, not overlapping
+const gcb_range gcb_ranges[] = {
+    { 0x00a9, 0x00a9, GCB_PICT }, { 0x00ad, 0x00ad, GCB_CONTROL }, { 0x00ae, 0x00ae, GCB_PICT },
+    { 0x0600, 0x0605, GCB_PREPEND }, { 0x06dd, 0x06dd, GCB_PREPEND }, { 0x070f, 0x070f, GCB_PREPEND },
+    { 0x0890, 0x0891, GCB_PREPEND }, { 0x08e2, 0x08e2, GCB_PREPEND },
+    { 0x0903, 0x0903, GCB_SPACING }, { 0x093b, 0x093b, GCB_SPACING }, { 0x093e, 0x0940, GCB_SPACING },
+    { 0x0949, 0x094c, GCB_SPACING }, { 0x094e, 0x094f, GCB_SPACING },
+    { 0x0982, 0x0983, GCB_SPACING }, { 0x09bf, 0x09c0, GCB_SPACING }, { 0x09c7, 0x09c8, GCB_SPACING },
+    { 0x09cb, 0x09cc, GCB_SPACING }, { 0x0a03, 0x0a03, GCB_SPACING }, { 0x0a3e, 0x0a40, GCB_SPACING },
+    { 0x0a83, 0x0a83, GCB_SPACING }, { 0x0abe, 0x0ac0, GCB_SPACING }, { 0x0ac9, 0x0ac9, GCB_SPACING },
+    { 0x0acb, 0x0acc, GCB_SPACING }, { 0x0b02, 0x0b03, GCB_SPACING }, { 0x0b40, 0x0b40, GCB_SPACING },
+    { 0x0b47, 0x0b48, GCB_SPACING }, { 0x0b4b, 0x0b4c, GCB_SPACING }, { 0x0bbf, 0x0bbf, GCB_SPACING },
+    { 0x0bc1, 0x0bc2, GCB_SPACING }, { 0x0bc6, 0x0bc8, GCB_SPACING }, { 0x0bca, 0x0bcc, GCB_SPACING },
+    { 0x0c01, 0x0c03, GCB_SPACING }, { 0x0c41, 0x0c44, GCB_SPACING }, { 0x0c82, 0x0c83, GCB_SPACING },
+    { 0x0cbe, 0x0cbe, GCB_SPACING }, { 0x0cc0, 0x0cc1, GCB_SPACING }, { 0x0cc3, 0x0cc4, GCB_SPACING },
+    { 0x0cc7, 0x0cc8, GCB_SPACING }, { 0x0cca, 0x0ccb, GCB_SPACING }, { 0x0d02, 0x0d03, GCB_SPACING },
+    { 0x0d3f, 0x0d40, GCB_SPACING }, { 0x0d46, 0x0d48, GCB_SPACING }, { 0x0d4a, 0x0d4c, GCB_SPACING },
+    { 0x0d4e, 0x0d4e, GCB_PREPEND }, { 0x0d82, 0x0d83, GCB_SPACING }, { 0x0dd0, 0x0dd1, GCB_SPACING },
+    { 0x0dd8, 0x0dde, GCB_SPACING }, { 0x0df2, 0x0df3, GCB_SPACING }, { 0x0e33, 0x0e33, GCB_SPACING },
+    { 0x0eb3, 0x0eb3, GCB_SPACING }, { 0x0f3e, 0x0f3f, GCB_SPACING }, { 0x0f7f, 0x0f7f, GCB_SPACING },
+    { 0x1031, 0x1031, GCB_SPACING }, { 0x103b, 0x103c, GCB_SPACING }, { 0x1056, 0x1057, GCB_SPACING },
+    { 0x1084, 0x1084, GCB_SPACING },
+    { 0x1100, 0x115f, GCB_L }, { 0x1160, 0x11a7, GCB_V }, { 0x11a8, 0x11ff, GCB_T },
+    { 0x17b6, 0x17b6, GCB_SPACING }, { 0x17be, 0x17c5, GCB_SPACING }, { 0x17c7, 0x17c8, GCB_SPACING },
+    { 0x1a55, 0x1a55, GCB_SPACING }, { 0x1a57, 0x1a57, GCB_SPACING }, { 0x1b04, 0x1b04, GCB_SPACING },
+    { 0x1b3b, 0x1b3b, GCB_SPACING }, { 0x1b3d, 0x1b41, GCB_SPACING }, { 0x1b43, 0x1b44, GCB_SPACING },
+    { 0x200b, 0x200b, GCB_CONTROL }, { 0x200c, 0x200c, GCB_EXTEND }, { 0x200d, 0x200d, GCB_ZWJ },
+    { 0x200e, 0x200f, GCB_CONTROL }, { 0x2028, 0x202e, GCB_CONTROL },
+    { 0x203c, 0x203c, GCB_PICT }, { 0x2049, 0x2049, GCB_PICT },
+    { 0x2060, 0x206f, GCB_CONTROL },
+    { 0x2122, 0x2122, GCB_PICT }, { 0x2139, 0x2139, GCB_PICT }, { 0x2194, 0x2199, GCB_PICT },
+    { 0x21a9, 0x21aa, GCB_PICT }, { 0x231a, 0x231b, GCB_PICT }, { 0x2328, 0x2328, GCB_PICT },
+    { 0x2388, 0x2388, GCB_PICT }, { 0x23cf, 0x23cf, GCB_PICT }, { 0x23e9, 0x23f3, GCB_PICT },
+    { 0x23f8, 0x23fa, GCB_PICT }, { 0x24c2, 0x24c2, GCB_PICT }, { 0x25aa, 0x25ab, GCB_PICT },
+    { 0x25b6, 0x25b6, GCB_PICT }, { 0x25c0, 0x25c0, GCB_PICT }, { 0x25fb, 0x25fe, GCB_PICT },
+    { 0x2600, 0x27bf, GCB_PICT }, { 0x2934, 0x2935, GCB_PICT }, { 0x2b05, 0x2b07, GCB_PICT },
+    { 0x2b1b, 0x2b1c, GCB_PICT }, { 0x2b50, 0x2b50, GCB_PICT }, { 0x2b55, 0x2b55, GCB_PICT },
+    { 0x3030, 0x3030, GCB_PICT }, { 0x303d, 0x303d, GCB_PICT }, { 0x3297, 0x3297, GCB_PICT },
+    { 0x3299, 0x3299, GCB_PICT },
+    { 0xa823, 0xa824, GCB_SPACING }, { 0xa827, 0xa827, GCB_SPACING }, { 0xa880, 0xa881, GCB_SPACING },
+    { 0xa8b4, 0xa8c3, GCB_SPACING }, { 0xa960, 0xa97c, GCB_L }, { 0xaaeb, 0xaaeb, GCB_SPACING },
+    { 0xaaee, 0xaaef, GCB_SPACING }, { 0xabe3, 0xabe4, GCB_SPACING }, { 0xabe6, 0xabe7, GCB_SPACING },
+    { 0xabe9, 0xabea, GCB_SPACING }, { 0xabec, 0xabec, GCB_SPACING },
+    { 0xd7b0, 0xd7c6, GCB_V }, { 0xd7cb, 0xd7fb, GCB_T },
+    { 0xfeff, 0xfeff, GCB_CONTROL }, { 0xff9e, 0xff9f, GCB_EXTEND }, { 0xfff0, 0xfffb, GCB_CONTROL },
+    { 0x110bd, 0x110bd, GCB_PREPEND }, { 0x110cd, 0x110cd, GCB_PREPEND },
+    { 0x1f000, 0x1f0ff, GCB_PICT }, { 0x1f10d, 0x1f10f, GCB_PICT }, { 0x1f12f, 0x1f12f, GCB_PICT },
+    { 0x1f16c, 0x1f171, GCB_PICT }, { 0x1f17e, 0x1f17f, GCB_PICT }, { 0x1f18e, 0x1f18e, GCB_PICT },
+    { 0x1f191, 0x1f19a, GCB_PICT }, { 0x1f1ad, 0x1f1e5, GCB_PICT }, { 0x1f1e6, 0x1f1ff, GCB_RI },
+    { 0x1f201, 0x1f20f, GCB_PICT }, { 0x1f21a, 0x1f21a, GCB_PICT }, { 0x1f22f, 0x1f22f, GCB_PICT },
+    { 0x1f232, 0x1f23a, GCB_PICT }, { 0x1f23c, 0x1f23f, GCB_PICT }, { 0x1f249, 0x1f3fa, GCB_PICT },
+    { 0x1f3fb, 0x1f3ff, GCB_EXTEND }, // skin tones
+    { 0x1f400, 0x1f53d, GCB_PICT }, { 0x1f546, 0x1f64f, GCB_PICT }, { 0x1f680, 0x1f6ff, GCB_PICT },
+    { 0x1f774, 0x1f77f, GCB_PICT }, { 0x1f7d5, 0x1f7ff, GCB_PICT }, { 0x1f80c, 0x1f80f, GCB_PICT },
+    { 0x1f848, 0x1f84f, GCB_PICT }, { 0x1f85a, 0x1f85f, GCB_PICT }, { 0x1f888, 0x1f88f, GCB_PICT },
+    { 0x1f8ae, 0x1f8ff, GCB_PICT }, { 0x1f90c, 0x1f93a, GCB_PICT }, { 0x1f93c, 0x1f945, GCB_PICT },
+    { 0x1f947, 0x1faff, GCB_PICT }, { 0x1fc00, 0x1fffd, GCB_PICT },
+    { 0xe0000, 0xe001f, GCB_CONTROL }, { 0xe0020, 0xe007f, GCB_EXTEND }, // tags of flag sequences
+    { 0xe0080, 0xe0fff, GCB_CONTROL },
+};
+
+#define GCB_RANGES ((int)(sizeof(gcb_ranges) / sizeof(*gcb_ranges)))
+
+inline static int gcb_prop(wchar_t wch) {
+    if(wch < 0x7f) {
+        if(wch >= 0x20) return GCB_OTHER;
+        if(wch == L'\r') return GCB_CR;
+        if(wch == L'\n') return GCB_LF;
+        return GCB_CONTROL;
+    }
+
+    if(wch < 0xa0) return GCB_CONTROL;
+
+    if(wch >= 0xac00 && wch <= 0xd7a3) { // precomposed hangul syllables
+        return ((wch - 0xac00) % 28) ? GCB_LVT : GCB_LV;
+    }
+
+    int lo = 0, hi = GCB_RANGES - 1;
+
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if(wch < gcb_ranges[mid].from) {
+            hi = mid - 1;
+        } else if(wch > gcb_ranges[mid].to) {
+            lo = mid + 1;
+        } else {
+            return gcb_ranges[mid].prop;
+        }
+    }
+
+    return (wch_width(wch) == 0) ? GCB_EXTEND : GCB_OTHER;
+}
+
+// carried from char to char for the rules looking further back than one char
+typedef struct gcb_state {
+    int prev;
+    char pict; // the last non-extend char was pictographic, GB11
+    char ri_odd; // an odd amount of regional indicators before, GB12 and GB13
+} gcb_state;
+
+#define GCB_STATE_START ((gcb_state) { .prev = GCB_CONTROL })
+
+// whether a cluster begins at the char of the prop, the state is moved past it
+inline static char gcb_step(gcb_state *s, int prop) {
+    int p = s->prev;
+    char brk;
+
+    if(p == GCB_CR && prop == GCB_LF) brk = 0; // GB3
+    else if(p == GCB_CR || p == GCB_LF || p == GCB_CONTROL) brk = 1; // GB4
+    else if(prop == GCB_CR || prop == GCB_LF || prop == GCB_CONTROL) brk = 1; // GB5
+    else if(p == GCB_L && (prop == GCB_L || prop == GCB_V || prop == GCB_LV || prop == GCB_LVT)) brk = 0; // GB6
+    else if((p == GCB_LV || p == GCB_V) && (prop == GCB_V || prop == GCB_T)) brk = 0; // GB7
+    else if((p == GCB_LVT || p == GCB_T) && prop == GCB_T) brk = 0; // GB8
+    else if(prop == GCB_EXTEND || prop == GCB_ZWJ || prop == GCB_SPACING) brk = 0; // GB9, GB9a
+    else if(p == GCB_PREPEND) brk = 0; // GB9b
+    else if(p == GCB_ZWJ && s->pict && prop == GCB_PICT) brk = 0; // GB11
+    else if(p == GCB_RI && prop == GCB_RI) brk = !s->ri_odd; // GB12, GB13
+    else brk = 1; // GB999
+
+    if(prop == GCB_PICT) s->pict = 1;
+    else if(prop != GCB_EXTEND && prop != GCB_ZWJ) s->pict = 0;
+    else if(prop == GCB_ZWJ && p == GCB_ZWJ) s->pict = 0;
+
+    s->ri_odd = (prop == GCB_RI) ? !s->ri_odd : 0;
+    s->prev = prop;
+
+    return brk;
+}
+
+#endif
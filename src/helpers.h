@@ -29,6 +29,8 @@
 #include "state.h"
 #include "draw.h"
 #include "line.h"
+#include "highlight.h"
+#include "syntaxes.h"
 
 wchar_t *wstr_copy(wchar_t *str) {
     if(!str) return NULL;
@@ -178,26 +180,274 @@ void switch_current_window(window *new_window) {
     order_draw_status();
 }
 
-void cursor_right();
+int cursor_move(window *w, int dy, int dx, char no_view);
+int adjust_view_for_cursor(window *w);
+
+// other windows showing the buffer keep their places through an edit: their offsets
+// are put in the buffer's anchors before it and read back after it. the editing window
+// moves it's own cursor, NULL if it doesn't. called with the buffer's block held
+void buffer_windows_anchor(buffer *b, window *self) {
+    for(window *w = S.grid->first; w != NULL; w = w->next) {
+        if(w->buff != b || w == self) continue;
+
+        anchor_set(&b->anchors, &w->cur_anchor, w->cur.l, w->cur.index, w->cur.pos);
+        anchor_set(&b->anchors, &w->view_anchor, w->view.l, w->view.index, w->view.pos);
+    }
+}
+
+void buffer_windows_follow(buffer *b, window *self) {
+    for(window *w = S.grid->first; w != NULL; w = w->next) {
+        if(w->buff != b || w == self) continue;
+
+        w->cur = (offset) {
+            .l = w->cur_anchor.l,
+            .index = anchor_index(&w->cur_anchor),
+            .pos = w->cur_anchor.pos,
+        };
+
+        w->view = (offset) {
+            .l = w->view_anchor.l,
+            .index = anchor_index(&w->view_anchor),
+            .pos = w->view_anchor.pos,
+        };
+    }
+}
+
+// all the windows showing the buffer, it's contents have changed
+void order_draw_buffer(buffer *b) {
+    for(window *w = S.grid->first; w != NULL; w = w->next) {
+        if(w->buff == b) order_draw_window(w);
+    }
+}
+
+// open a transaction grouping the buffer's edits: the highlighting of the edited lines
+// and the drawing of the windows showing the buffer wait for the matching buffer_commit,
+// so that a compound edit is highlighted and drawn once. transactions nest.
+// the buffer's block is still taken by every edit, it's never held in between
+void buffer_begin(buffer *b) {
+    atomic_fetch_add(&b->tx_depth, 1);
+}
+
+// close the transaction, the last one highlights all the lines edited meanwhile
+// at once and orders the buffer's windows to be drawn if any of them were
+void buffer_commit(buffer *b) {
+    if(atomic_load(&b->tx_depth) <= 0) return;
+    if(atomic_fetch_sub(&b->tx_depth, 1) > 1) return;
+
+    pthread_mutex_lock(&b->block);
+
+    if(b->tx_changed) {
+        int from = anchor_index(&b->tx_from);
+        int lines = anchor_index(&b->tx_to) - from + 1;
+
+        if(highlight_update_range(b, b->tx_from.l, lines, HL_UPDATE_LIMIT)) order_highlight();
+
+        anchor_detach(&b->tx_from);
+        anchor_detach(&b->tx_to);
+        b->tx_changed = 0;
+    }
+
+    pthread_mutex_unlock(&b->block);
+
+    if(atomic_exchange(&b->tx_draw, 0)) order_draw_buffer(b);
+}
+
+// hold the edits of any buffer: the first one gets the buffer a transaction,
+// which is committed by edits_release. see draw_hold
+void edits_hold() {
+    S.edits_held = 1;
+}
+
+void edits_release() {
+    S.edits_held = 0;
+
+    while(S.tx_held) {
+        buffer *b = S.tx_held;
+
+        S.tx_held = b->tx_held_next;
+        b->tx_held_next = NULL;
+        b->tx_held = 0;
+
+        buffer_commit(b);
+    }
+}
+
+// the lines from from up to to were edited, must be called with the buffer's block locked
+// after the anchors have been moved. they're highlighted now unless a transaction is open
+void buffer_changed(buffer *b, line *from, int from_index, line *to, int to_index) {
+    b->changes++;
+
+    if(S.edits_held && !b->tx_held) {
+        buffer_begin(b);
+
+        b->tx_held = 1;
+        b->tx_held_next = S.tx_held;
+        S.tx_held = b;
+    }
+
+    if(!atomic_load(&b->tx_depth)) {
+        if(highlight_update_range(b, from, to_index - from_index + 1, HL_UPDATE_LIMIT)) order_highlight();
+        return;
+    }
+
+    if(!b->tx_changed) {
+        anchor_attach(&b->anchors, &b->tx_from, from, from_index, 0);
+        anchor_attach(&b->anchors, &b->tx_to, to, to_index, 0);
+        b->tx_changed = 1;
+        return;
+    }
+
+    if(from_index < anchor_index(&b->tx_from)) anchor_attach(&b->anchors, &b->tx_from, from, from_index, 0);
+    if(to_index > anchor_index(&b->tx_to)) anchor_attach(&b->anchors, &b->tx_to, to, to_index, 0);
+}
 
 // this technically needs to be moved to commands.h, but who cares?
 void buffer_insert_at_cursor(window *w, wchar_t ch) {
-    pthread_mutex_lock(&w->buff->block);
+    buffer *b = w->buff;
+
+    pthread_mutex_lock(&b->block);
+
+    buffer_windows_anchor(b, w);
 
     line_insert(w->cur.l, DCH(ch), w->cur.pos);
+    anchors_insert(&b->anchors, w->cur.index, w->cur.pos, 0, w->cur.l, w->cur.pos + 1);
+    buffer_changed(b, w->cur.l, w->cur.index, w->cur.l, w->cur.index);
 
-    cursor_right();
+    buffer_windows_follow(b, w);
 
-    pthread_mutex_unlock(&w->buff->block);
+    cursor_move(w, 0, 1, 0); // past the inserted char, the view and fast modes don't apply
 
-    order_draw_window(w);
+    pthread_mutex_unlock(&b->block);
+
+    order_draw_buffer(b);
+}
+
+inline static char _is_newline(wchar_t wch) {
+    return wch == L'\n' || wch == L'\r' || wch == NCKEY_ENTER;
+}
+
+// convert text from *i up to the next newline, *i is moved past it.
+// \r\n counts as a single newline. returns the number of dchars
+inline static int _text_line(wchar_t *text, int len, int *i, dchar *dchs, char *newline) {
+    int n = 0;
+
+    *newline = 0;
+
+    for(; *i < len; (*i)++) {
+        wchar_t wch = text[*i];
+
+        if(_is_newline(wch)) {
+            *newline = 1;
+            (*i)++;
+
+            if(wch == L'\r' && *i < len && text[*i] == L'\n') (*i)++;
+
+            break;
+        }
+
+        dchs[n++] = DCH(wch);
+    }
+
+    return n;
+}
+
+// insert the text as a single modification: the buffer is locked, highlighted
+// and redrawn once however long the text is. prompts take the first line only,
+// the newline that ends it is left for the caller to process as a key.
+// returns the number of inserted wchars of text, negative if nothing could be
+int buffer_insert_text_at_cursor(window *w, wchar_t *text, int len) {
+    if(!w || !w->buff || !text) return -1;
+    if(len <= 0) return 0;
+
+    dchar *dchs = (dchar *)malloc(sizeof(*dchs) * len);
+
+    if(!dchs) return -2;
+
+    buffer *b = w->buff;
+    offset *cur = &w->cur;
+
+    pthread_mutex_lock(&b->block);
+
+    buffer_windows_anchor(b, w);
+
+    line *first = cur->l;
+    int index = cur->index, pos = cur->pos;
+    int i = 0;
+    char newline;
+
+    int n = _text_line(text, len, &i, dchs, &newline);
+    int inserted = len;
+
+    if(!newline || flag_is_on(b->flags, BUFFER_PROMPT)) {
+        if(newline) inserted = n; // up to the newline
+        line_insert_multi(first, dchs, n, cur->pos);
+        cur->pos += n;
+    } else {
+        // the rest of the cursor's line goes after the last line of the text
+        int rest_len = first->len - cur->pos;
+        line *rest = line_empty(rest_len + 4);
+
+        line_append_multi(rest, first->dstr + cur->pos, rest_len);
+
+        first->len = cur->pos;
+        line_insert_multi(first, dchs, n, cur->pos);
+
+        line *prev = first;
+
+        while(1) {
+            n = _text_line(text, len, &i, dchs, &newline);
+
+            if(!newline) break;
+
+            line *l = line_empty(n + 4);
+            line_append_multi(l, dchs, n);
+
+            list_insert_after(BUFFER_LIST(b), (node *)prev, (node *)l);
+            prev = l;
+            cur->index++;
+        }
+
+        line_insert_multi(rest, dchs, n, 0);
+        list_insert_after(BUFFER_LIST(b), (node *)prev, (node *)rest);
+        cur->index++;
+
+        cur->l = rest;
+        cur->pos = n;
+    }
+
+    free(dchs);
+
+    anchors_insert(&b->anchors, index, pos, cur->index - index, cur->l, cur->pos);
+    buffer_changed(b, first, index, cur->l, cur->index);
+
+    buffer_windows_follow(b, w);
+
+    w->last_col = line_col(cur->l, cur->pos);
+    adjust_view_for_cursor(w);
+
+    pthread_mutex_unlock(&b->block);
+
+    order_draw_buffer(b);
+
+    return inserted;
 }
 
 void buffer_destroy(buffer *b) {
     if(flag_is_on(b->flags, BUFFER_PROMPT)) {
         blist_remove(S.blist_prompts, b);
     } else {
+        // the highlight loop mustn't find the buffer after it's freed
+        pthread_mutex_lock(&S.highlight_block);
         blist_remove(S.blist, b);
+        pthread_mutex_unlock(&S.highlight_block);
+    }
+
+    // a transaction held for the buffer is dropped with it
+    for(buffer **p = &S.tx_held; *p; p = &(*p)->tx_held_next) {
+        if(*p != b) continue;
+
+        *p = b->tx_held_next;
+        break;
     }
     
     callback on_destroy = b->on_destroy;
@@ -206,7 +456,9 @@ void buffer_destroy(buffer *b) {
     window *w = (window *)b->current_window;
     if(w) {
         w->buff = buffer_empty(L"*empty*");
+        pthread_mutex_lock(&S.highlight_block);
         blist_insert(S.blist, w->buff);
+        pthread_mutex_unlock(&S.highlight_block);
         order_draw_window(w);
     }
 
@@ -225,6 +477,8 @@ void save_buffer(buffer *b) {
 
     if(!fp) return;
 
+    pthread_mutex_lock(&b->block); // the highlighting may replace shared chars meanwhile
+
     for(line *l = b->first; l != NULL; l = l->next) {
         if(ferror(fp)) {
             break;
@@ -244,6 +498,8 @@ void save_buffer(buffer *b) {
         }
     }
 
+    pthread_mutex_unlock(&b->block);
+
     fclose(fp);
 }
 
@@ -261,7 +517,7 @@ void window_destroy(window *w) {
         S.current_window = S.grid->first;
     }
 
-    free(w);
+    window_free(w);
 }
 
 void on_resize(); // this is why I will move UNN to Lisp!
@@ -330,8 +586,7 @@ void prompt_cb_file_open(buffer *b) {
         return;
     }
 
-    free(b->first);
-    free(b->first->dstr);
+    line_free(b->first);
     b->first = NULL;
     b->last = NULL;
 
@@ -376,6 +631,8 @@ void prompt_cb_file_open(buffer *b) {
 
         nb = buffer_from_lines(path, first, last, line_count);
         nb->path = path;
+
+        nb->syn = syntax_for_path(path);
     }
 
     goto good;
@@ -393,7 +650,11 @@ void prompt_cb_file_open(buffer *b) {
 
     nb->draw = (draw_func)draw_window;
 
+    pthread_mutex_lock(&S.highlight_block);
     blist_insert(S.blist, nb);
+    pthread_mutex_unlock(&S.highlight_block);
+
+    if(nb->syn) order_highlight();
 
     w->buff = nb;
     w->cur = (offset) {
@@ -425,8 +686,7 @@ void prompt_cb_file_save(buffer *b) {
         return;
     }
 
-    free(b->first->dstr);
-    free(b->first);
+    line_free(b->first);
 
     b->first = NULL;
     b->last = NULL;
@@ -441,6 +701,26 @@ void prompt_cb_file_save(buffer *b) {
 
     w->buff->name = wstr_copy(path);
 
+    // the new extension might name another syntax
+    const syntax *syn = syntax_for_path(path);
+
+    if(syn != w->buff->syn) {
+        pthread_mutex_lock(&w->buff->block);
+
+        w->buff->syn = syn;
+
+        if(syn) {
+            highlight_invalidate(w->buff);
+        } else {
+            highlight_clear(w->buff);
+        }
+
+        pthread_mutex_unlock(&w->buff->block);
+
+        order_highlight();
+        order_draw_window(w);
+    }
+
     save_buffer(w->buff);
 
     prompt_cb_default(b);
@@ -448,10 +728,161 @@ void prompt_cb_file_save(buffer *b) {
     order_draw_status();
 }
 
+// move the view by dy visual rows of a wrapped window with tw text width
+// returns not 0 if nothing has changed
+int _view_move_wrapped(window *w, int dy, int tw) {
+    offset *view = &w->view;
+
+    offset initial = *view;
+
+    for(; dy > 0; dy--) {
+        int row = line_pos_row(view->l, tw, view->pos);
+
+        if(row + 1 < line_wrap_rows(view->l, tw)) {
+            view->pos = line_row_pos(view->l, tw, row + 1);
+        } else if(view->l->next) {
+            view->l = view->l->next;
+            view->index++;
+            view->pos = 0;
+        } else break;
+    }
+
+    for(; dy < 0; dy++) {
+        int row = line_pos_row(view->l, tw, view->pos);
+
+        if(row > 0) {
+            view->pos = line_row_pos(view->l, tw, row - 1);
+        } else if(view->l->prev) {
+            view->l = view->l->prev;
+            view->index--;
+            view->pos = line_row_pos(view->l, tw, line_wrap_rows(view->l, tw) - 1);
+        } else break;
+    }
+
+    return (view->l == initial.l) && (view->pos == initial.pos);
+}
+
+// keeps the cursor's visual row inside the view of a wrapped window,
+// looks through at most a view's height of rows
+int _adjust_view_for_cursor_wrapped_tw(window *w, int tw) {
+    int height = w->pos.y2 - w->pos.y1 + 1;
+
+    offset *view = &w->view;
+    offset *cur = &w->cur;
+
+    window_wrap_normalize(w, tw);
+
+    int cur_row = line_pos_row(cur->l, tw, cur->pos);
+    int view_row = line_pos_row(view->l, tw, view->pos);
+
+    // cursor is above the view
+    if(cur->index < view->index || (cur->l == view->l && cur_row < view_row)) {
+        view->l = cur->l;
+        view->index = cur->index;
+        view->pos = line_row_pos(cur->l, tw, cur_row);
+        return 0;
+    }
+
+    // count the rows between the view's top and the cursor
+    int rows = 0;
+
+    for(line *l = view->l; l != NULL && rows < height; l = l->next) {
+        if(l == cur->l) {
+            rows += cur_row - view_row;
+
+            if(rows < height) return 1; // visible
+
+            break;
+        }
+
+        rows += line_wrap_rows(l, tw) - view_row;
+        view_row = 0;
+    }
+
+    // cursor is below the view, make it the bottom row
+    view->l = cur->l;
+    view->index = cur->index;
+    view->pos = line_row_pos(cur->l, tw, cur_row);
+
+    _view_move_wrapped(w, -(height - 1), tw);
+
+    return 0;
+}
+
+int _adjust_view_for_cursor_wrapped(window *w) {
+    int tw = window_text_width(w);
+    int r = _adjust_view_for_cursor_wrapped_tw(w, tw);
+
+    // moving the view might have changed line numbers' width
+    if(window_text_width(w) != tw) {
+        _adjust_view_for_cursor_wrapped_tw(w, window_text_width(w));
+    }
+
+    return r;
+}
+
+// position in the visual row closest to the column inside of it
+inline static int _line_row_col_pos(line *l, int tw, int row, int col) {
+    int start = line_row_pos(l, tw, row);
+    int next = line_row_next(l, tw, start);
+    int pos = line_pos_in_col(l, line_col(l, start) + col);
+
+    if(next >= 0 && pos >= next) pos = next - 1; // went past the row's end
+
+    pos = line_grapheme_start(l, pos);
+
+    return (pos < start) ? start : pos;
+}
+
+// move the cursor by dy visual rows of a wrapped window, keeping the visual column
+// returns not 0 if nothing has changed
+int _cursor_move_wrapped(window *w, int dy) {
+    int tw = window_text_width(w);
+
+    offset *cur = &w->cur;
+    offset initial = *cur;
+
+    // rows don't begin at multiples of tw once a tab or a wide char has crossed a row's end,
+    // the visual column is taken from the beginning of the cursor's row
+    int base = line_col(cur->l, line_row_pos(cur->l, tw, line_pos_row(cur->l, tw, cur->pos)));
+    int col = (w->last_col >= base && w->last_col - base < tw) ? w->last_col - base : w->last_col % tw;
+
+    for(; dy > 0; dy--) {
+        int row = line_pos_row(cur->l, tw, cur->pos);
+
+        if(row + 1 < line_wrap_rows(cur->l, tw)) {
+            cur->pos = _line_row_col_pos(cur->l, tw, row + 1, col);
+        } else if(cur->l->next) {
+            cur->l = cur->l->next;
+            cur->index++;
+            cur->pos = _line_row_col_pos(cur->l, tw, 0, col);
+        } else break;
+    }
+
+    for(; dy < 0; dy++) {
+        int row = line_pos_row(cur->l, tw, cur->pos);
+
+        if(row > 0) {
+            cur->pos = _line_row_col_pos(cur->l, tw, row - 1, col);
+        } else if(cur->l->prev) {
+            cur->l = cur->l->prev;
+            cur->index--;
+            cur->pos = _line_row_col_pos(cur->l, tw, line_wrap_rows(cur->l, tw) - 1, col);
+        } else break;
+    }
+
+    return (cur->l == initial.l) && (cur->pos == initial.pos);
+}
+
 // returns not 0 if nothing has changed
 // similar to cursor_move, for comments check it out
 int view_move(window *w, int dy, int dx) {
     if(!w) return -1;
+    if(!w->view.l) return -1;
+
+    if(flag_is_on(w->flags, WINDOW_WRAP)) { // no horizontal view movement when wrapping
+        return _view_move_wrapped(w, dy, window_text_width(w));
+    }
 
     int height = w->pos.y2 - w->pos.y1;
     offset *view = &w->view;
@@ -532,19 +963,23 @@ int view_move(window *w, int dy, int dx) {
 }
 
 int adjust_view_for_cursor(window *w) {
+    if(flag_is_on(w->flags, WINDOW_WRAP)) {
+        return _adjust_view_for_cursor_wrapped(w);
+    }
+
     int cidx = w->cur.index;
     int cpos = w->cur.pos;
 
-    int is_markers = !!flag_is_on(w->flags, WINDOW_LONG_MARKS);
-    int dc = (w->dc) ? (w->dc + 1) : 0;
-
     int height = w->pos.y2 - w->pos.y1 + 1;
-    int width = w->pos.x2 - w->pos.x1 + 1;
+    int tw = window_text_width(w);
 
     int top_line = w->view.index;
     int bottom_line = top_line + height - 1;
-    int left_border = w->view.pos;
-    int right_border = left_border + width - is_markers - dc;
+
+    // horizontal borders are in columns of the cursor's line
+    int ccol = line_col(w->cur.l, cpos);
+    int left_border = line_col(w->cur.l, w->view.pos);
+    int right_border = left_border + tw;
 
     int view_x = -1;
     int view_dy = 0;
@@ -557,12 +992,11 @@ int adjust_view_for_cursor(window *w) {
         view_dy = cidx - bottom_line;
     }
 
-    logg("border: %d; cpos: %d\n", right_border, cpos);
+    logg("border: %d; ccol: %d\n", right_border, ccol);
 
-    if(left_border > cpos) { // change the whole view window if cur is in the different section
-        int attempt = cpos - width + 1 + dc + is_markers;
-        view_x = (attempt > 0) ? attempt : 0;
-    } else if(right_border <= cpos) { // + 1 for side markers
+    if(w->view.pos > cpos) { // change the whole view window if cur is in the different section
+        view_x = line_pos_at_col(w->cur.l, ccol - tw + 1);
+    } else if(right_border <= ccol) {
         view_x = cpos;
     }
 
@@ -630,7 +1064,11 @@ int cursor_move(window *w, int dy, int dx, char no_view) {
 
     if(!l) return -1;
 
-    if(dy) { // if we move vertically
+    if(dy && flag_is_on(w->flags, WINDOW_WRAP)) { // move through visual rows
+        if(!_cursor_move_wrapped(w, dy)) {
+            changed = 1;
+        }
+    } else if(dy) { // if we move vertically
         line *initial_line = l;
         char is_up = (dy < 0); // are we going up or down?
 
@@ -657,33 +1095,29 @@ int cursor_move(window *w, int dy, int dx, char no_view) {
             cur->l = l;
             cur->index = new_index;
 
-            if(w->last_pos <= l->len) {
-                cur->pos = w->last_pos;
-            } else {
-                cur->pos = l->len;
-            }
+            // O(log len) lookup in the line's column cache
+            cur->pos = line_grapheme_start(l, line_pos_in_col(l, w->last_col));
         }
     }
 
     if(dx) { // if we move horizontally
-        char is_left = (dx < 0); // are we moving to the left?
-        int new_pos = cur->pos + dx;
+        int new_pos = cur->pos;
 
-        if(is_left) {
-            if(new_pos < 0) {
-                new_pos = 0; // 0 is the leftmost limit
-            }
-        } else {
-            if(new_pos > l->len) {
-                new_pos = l->len; // line of the line is the rightmost limit
-            }
+        // by whole grapheme clusters, from the line's cached boundaries.
+        // 0 and the line's length are the limits
+        for(; dx < 0 && new_pos > 0; dx++) {
+            new_pos = line_grapheme_prev(l, new_pos);
+        }
+
+        for(; dx > 0 && new_pos < l->len; dx--) {
+            new_pos = line_grapheme_next(l, new_pos);
         }
 
         if(new_pos != cur->pos) { // if we really have moved
             changed = 1;
 
             cur->pos = new_pos;
-            w->last_pos = new_pos;
+            w->last_col = line_col(l, new_pos);
         }
     }
 
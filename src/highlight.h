@@ -0,0 +1,453 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_HIGHLIGHT_H_
+#define __UNN_HIGHLIGHT_H_
+
+#include <wchar.h>
+#include <wctype.h>
+
+#include "colors.h"
+#include "flags.h"
+#include "line.h"
+#include "buffer.h"
+
+// incremental syntax highlighting driven by rule tables (see syntaxes.h).
+// every line keeps the lexer state it ends in, so after an edit
+// lines are highlighted from the edited one until a line ends
+// in the same state as before, the rest of the buffer is up to date.
+// whole buffers are highlighted in the background by chunks (see highlight_loop),
+// lines shown by windows go first
+
+// line's hl_valid values
+#define HL_VALID 1 // lexed starting in the right state
+#define HL_GUESSED 2 // lexed ahead of the lines above it, might be wrong
+
+#define HL_UPDATE_LIMIT 256 // lines lexed on an edit, the rest is done in the background
+#define HL_CHUNK 1024 // lines lexed by a single step of the background highlighting
+
+// token classes
+#define HL_NONE 0
+#define HL_KEYWORD 1
+#define HL_TYPE 2
+#define HL_STRING 3
+#define HL_COMMENT 4
+#define HL_NUMBER 5
+#define HL_PREPROC 6
+#define HL_ERROR 7
+#define HL_WARNING 8
+#define HL_CLASSES 9
+
+// rule types
+#define HL_RULE_SPAN 1 // from start to end delimiter
+#define HL_RULE_LINE 2 // from start to the end of the line
+#define HL_RULE_WORDS 3 // whole words from a list
+#define HL_RULE_NUMBER 4 // numeric literals
+
+// rule flags
+#define HL_RULE_MULTILINE 1 // span may continue on the next lines
+#define HL_RULE_BOL 2 // only matches at the first non-blank char of a line
+
+typedef struct hl_rule {
+    int type;
+    int cls;
+    int flags;
+
+    const wchar_t *start, *end;
+    wchar_t escape; // 0 if the span has no escapes
+
+    const wchar_t **words; // NULL-terminated
+} hl_rule;
+
+typedef struct syntax {
+    const wchar_t *name;
+    const wchar_t **exts; // NULL-terminated, with the dot
+
+    const hl_rule *rules;
+    int rules_count;
+} syntax;
+
+// foreground of each token class, background is left to the window
+rgb hl_palette[HL_CLASSES] = {
+    [HL_NONE] = RGB(0, 0, 0),
+    [HL_KEYWORD] = RGB(0, 0, 160),
+    [HL_TYPE] = RGB(0, 110, 110),
+    [HL_STRING] = RGB(160, 60, 0),
+    [HL_COMMENT] = RGB(110, 110, 110),
+    [HL_NUMBER] = RGB(140, 0, 140),
+    [HL_PREPROC] = RGB(120, 70, 0),
+    [HL_ERROR] = RGB(200, 0, 0),
+    [HL_WARNING] = RGB(170, 120, 0),
+};
+
+// manually colored chars are left as they are. line_own may replace and unref the line's
+// chars, which is safe because the highlighting holds b->block and so does every reader of them
+inline static void hl_set(line *l, int from, int to, int cls) {
+    if(l->shared) { // shared chars are copied only if their colors change
+        char same = 1;
+
+        for(int i = from; i < to && same; i++) {
+            dchar *dch = l->dstr + i;
+
+            if(flag_is_on(dch->flags, DCHAR_COLORED)) continue;
+
+            rgb fg = hl_palette[cls];
+
+            same = (cls == HL_NONE) ? flag_is_off(dch->flags, DCHAR_SYNTAX) :
+                flag_is_on(dch->flags, DCHAR_SYNTAX) &&
+                dch->color.fg.r == fg.r && dch->color.fg.g == fg.g && dch->color.fg.b == fg.b;
+        }
+
+        if(same || line_own(l)) return;
+    }
+
+    for(int i = from; i < to; i++) {
+        dchar *dch = l->dstr + i;
+
+        if(flag_is_on(dch->flags, DCHAR_COLORED)) continue;
+
+        if(cls == HL_NONE) {
+            dch->flags &= ~DCHAR_SYNTAX;
+        } else {
+            dch->flags |= DCHAR_SYNTAX;
+            dch->color.fg = hl_palette[cls];
+        }
+    }
+}
+
+inline static int hl_is_word(wchar_t wch) {
+    return iswalnum(wch) || wch == L'_';
+}
+
+// length of str if it begins at pos, 0 otherwise
+inline static int hl_match(line *l, int pos, const wchar_t *str) {
+    int i = 0;
+
+    for(; str[i]; i++) {
+        if(pos + i >= l->len) return 0;
+        if(l->dstr[pos + i].wch != str[i]) return 0;
+    }
+
+    return i;
+}
+
+// position after the span's end delimiter, -1 if the span doesn't end on this line
+int hl_span_end(const hl_rule *r, line *l, int from) {
+    for(int i = from; i < l->len; i++) {
+        if(r->escape && l->dstr[i].wch == r->escape) {
+            i++;
+            continue;
+        }
+
+        int len = hl_match(l, i, r->end);
+
+        if(len) return i + len;
+    }
+
+    return -1;
+}
+
+// position after the matched token, 0 if the rule doesn't match at pos
+int hl_rule_match(const hl_rule *r, line *l, int pos) {
+    switch(r->type) {
+        case HL_RULE_SPAN:
+        case HL_RULE_LINE:
+            return hl_match(l, pos, r->start) ? pos + 1 : 0;
+
+        case HL_RULE_WORDS: {
+            int end = pos;
+            while(end < l->len && hl_is_word(l->dstr[end].wch)) end++;
+
+            for(const wchar_t **w = r->words; *w; w++) {
+                if(hl_match(l, pos, *w) == end - pos) return end;
+            }
+
+            return 0;
+        }
+
+        case HL_RULE_NUMBER: {
+            if(!iswdigit(l->dstr[pos].wch)) return 0;
+
+            int end = pos;
+            while(end < l->len && (hl_is_word(l->dstr[end].wch) || l->dstr[end].wch == L'.')) end++;
+
+            return end;
+        }
+    }
+
+    return 0;
+}
+
+// highlight a line starting in the given state, returns the state it ends in.
+// state is 0 outside of multiline spans, otherwise an index of the open span's rule + 1
+int highlight_line(const syntax *syn, line *l, int state) {
+    int pos = 0;
+
+    if(state > 0 && state <= syn->rules_count) { // continue an open span
+        const hl_rule *r = syn->rules + state - 1;
+        int end = hl_span_end(r, l, 0);
+
+        if(end < 0) {
+            hl_set(l, 0, l->len, r->cls);
+            return state;
+        }
+
+        hl_set(l, 0, end, r->cls);
+        pos = end;
+    }
+
+    int first = 0;
+    while(first < l->len && iswspace(l->dstr[first].wch)) first++;
+
+    while(pos < l->len) {
+        char is_word_start = hl_is_word(l->dstr[pos].wch) &&
+            !(pos > 0 && hl_is_word(l->dstr[pos - 1].wch));
+
+        int end = 0;
+        const hl_rule *r = syn->rules;
+
+        for(int i = 0; i < syn->rules_count; i++, r++) {
+            if(flag_is_on(r->flags, HL_RULE_BOL) && pos != first) continue;
+
+            if((r->type == HL_RULE_WORDS || r->type == HL_RULE_NUMBER) && !is_word_start) continue;
+
+            end = hl_rule_match(r, l, pos);
+
+            if(!end) continue;
+
+            if(r->type == HL_RULE_LINE) {
+                end = l->len;
+            } else if(r->type == HL_RULE_SPAN) {
+                end = hl_span_end(r, l, pos + wcslen(r->start));
+
+                if(end < 0) {
+                    hl_set(l, pos, l->len, r->cls);
+                    return flag_is_on(r->flags, HL_RULE_MULTILINE) ? i + 1 : 0;
+                }
+            }
+
+            hl_set(l, pos, end, r->cls);
+            break;
+        }
+
+        if(end) {
+            pos = end;
+        } else if(is_word_start) { // skip the whole identifier
+            end = pos;
+            while(end < l->len && hl_is_word(l->dstr[end].wch)) end++;
+
+            hl_set(l, pos, end, HL_NONE);
+            pos = end;
+        } else {
+            hl_set(l, pos, pos + 1, HL_NONE);
+            pos++;
+        }
+    }
+
+    return 0;
+}
+
+// lexes from the line until it ends in the same state as before,
+// at most limit lines. returns the number of lexed lines, *left is set
+// if the limit was reached before that
+int _highlight_walk(buffer *b, line *l, int limit, char *left) {
+    int state = (l->prev) ? l->prev->hl_state : 0;
+    int count = 0;
+
+    *left = 0;
+
+    for(; l; l = l->next) {
+        if(count == limit) {
+            l->hl_valid = 0; // so that it's found by highlight_work
+            *left = 1;
+            break;
+        }
+
+        char was_valid = (l->hl_valid == HL_VALID);
+        int old = l->hl_state;
+
+        state = highlight_line(b->syn, l, state);
+        count++;
+
+        l->hl_state = state;
+        l->hl_valid = HL_VALID;
+
+        // the next line starts in the same state as before
+        if(was_valid && old == state) break;
+    }
+
+    return count;
+}
+
+// highlight after the line has been edited, at most limit lines are lexed,
+// returns not 0 if the rest is left for the background highlighting
+int highlight_update(buffer *b, line *l, int limit) {
+    if(!b->syn) return 0;
+
+    char left;
+    _highlight_walk(b, l, limit, &left);
+
+    return left;
+}
+
+// highlight after lines lines from l on have been edited at once. the walk stops
+// where the states settle, edited lines past it are left for the background highlighting
+int highlight_update_range(buffer *b, line *l, int lines, int limit) {
+    if(!b->syn) return 0;
+
+    char left;
+    int count = _highlight_walk(b, l, limit, &left);
+
+    return left || count < lines;
+}
+
+// mark the whole buffer for the background highlighting
+void highlight_invalidate(buffer *b) {
+    for(line *l = b->first; l; l = l->next) {
+        l->hl_valid = 0;
+    }
+
+    b->hl_next = NULL;
+    b->hl_next_changes = -1;
+}
+
+// remove all the highlighting, for buffers left without a syntax
+void highlight_clear(buffer *b) {
+    for(line *l = b->first; l; l = l->next) {
+        hl_set(l, 0, l->len, HL_NONE);
+        l->hl_valid = 0;
+    }
+}
+
+// remember lines shown by a window, called when it's drawn.
+// returns not 0 if some of them aren't highlighted for sure yet
+int highlight_view_record(buffer *b, void *owner, line *l, int index, int height) {
+    if(!b->syn) return 0;
+
+    hl_view *v = b->hl_views;
+
+    for(int i = 0; i < HL_VIEWS; i++) {
+        if(b->hl_views[i].owner == owner) {
+            v = b->hl_views + i;
+            break;
+        }
+
+        if(!b->hl_views[i].l) v = b->hl_views + i; // free slot
+    }
+
+    *v = (hl_view) {
+        .owner = owner,
+        .l = l,
+        .index = index,
+        .height = height,
+        .changes = b->changes,
+    };
+
+    for(int i = 0; l && i < height; i++, l = l->next) {
+        if(l->hl_valid != HL_VALID) return 1;
+    }
+
+    return 0;
+}
+
+// lex not highlighted lines of the recorded views,
+// starting with the state the previous line ends in even if it isn't known for sure
+int _highlight_views(buffer *b) {
+    int count = 0;
+
+    for(int i = 0; i < HL_VIEWS; i++) {
+        hl_view *v = b->hl_views + i;
+
+        if(!v->l || v->changes != b->changes) continue;
+
+        line *l = v->l;
+
+        for(int j = 0; l && j < v->height; j++, l = l->next) {
+            if(l->hl_valid) continue;
+
+            int state = (l->prev && l->prev->hl_valid) ? l->prev->hl_state : 0;
+
+            l->hl_state = highlight_line(b->syn, l, state);
+            l->hl_valid = HL_GUESSED;
+
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// one step of the background highlighting, done with b->block locked:
+// visible lines first, then a chunk of lines from the first one not highlighted for sure.
+// *publish is set if visible lines were recolored.
+// returns not 0 if there is still work left
+int highlight_work(buffer *b, char *publish) {
+    *publish = 0;
+
+    if(!b->syn) return 0;
+
+    if(_highlight_views(b)) {
+        *publish = 1;
+        b->hl_changes++;
+        return 1;
+    }
+
+    line *l = b->first;
+    int index = 0;
+
+    if(b->hl_next && b->hl_next_changes == b->changes) { // continue from the last step
+        l = b->hl_next;
+        index = b->hl_next_index;
+    }
+
+    for(; l && l->hl_valid == HL_VALID; l = l->next) {
+        index++;
+    }
+
+    if(!l) {
+        b->hl_next = NULL;
+        return 0;
+    }
+
+    char left;
+    int count = _highlight_walk(b, l, HL_CHUNK, &left);
+
+    for(int i = 0; i < HL_VIEWS; i++) {
+        hl_view *v = b->hl_views + i;
+
+        if(v->l && index < v->index + v->height && v->index < index + count) {
+            *publish = 1;
+        }
+    }
+
+    if(*publish) b->hl_changes++;
+
+    // continue right after the lexed lines if nothing changes meanwhile
+    line *next = l;
+    for(int i = 0; next && i < count; i++) {
+        next = next->next;
+    }
+
+    b->hl_next = next;
+    b->hl_next_index = index + count;
+    b->hl_next_changes = b->changes;
+
+    return 1;
+}
+
+#endif
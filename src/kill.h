@@ -0,0 +1,124 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_KILL_H_
+#define __UNN_KILL_H_
+
+#include <stdlib.h>
+
+#include "line.h"
+
+#define KILL_RING_SIZE 16
+
+// chars of a line taken by a kill, they're shared with the line instead of copied
+typedef struct kill_slice {
+    dchunk *c;
+    int off, len;
+} kill_slice;
+
+// a copied selection, a slice per line
+typedef struct kill_entry {
+    char is_rect; // pasted as a column of slices instead of lines
+    int count;
+    kill_slice *slices;
+} kill_entry;
+
+// the latest kills, older ones are dropped
+typedef struct kill_ring {
+    int len;
+    int last; // index of the latest kill
+    kill_entry kills[KILL_RING_SIZE];
+} kill_ring;
+
+void kill_entry_clear(kill_entry *k) {
+    for(int i = 0; i < k->count; i++) {
+        dchunk_unref(k->slices[i].c);
+    }
+
+    free(k->slices);
+
+    k->slices = NULL;
+    k->count = 0;
+}
+
+// returns -1 if not enough memory
+int kill_entry_new(kill_entry *k, int count, char is_rect) {
+    k->slices = (kill_slice *)malloc(sizeof(*k->slices) * count);
+
+    if(!k->slices) return -1;
+
+    k->count = 0;
+    k->is_rect = is_rect;
+
+    return 0;
+}
+
+// share len chars of the line from pos, returns -1 if not enough memory
+int kill_entry_append(kill_entry *k, line *l, int pos, int len) {
+    dchunk *c = line_share(l);
+
+    if(!c) return -1;
+
+    k->slices[k->count++] = (kill_slice) {
+        .c = c,
+        .off = (int)(l->dstr - c->dchs) + pos,
+        .len = len,
+    };
+
+    return 0;
+}
+
+inline static dchar *kill_slice_dchs(kill_slice *s) {
+    return s->c->dchs + s->off;
+}
+
+void kill_ring_free(kill_ring *r) {
+    if(!r) return;
+
+    for(int i = 0; i < r->len; i++) {
+        kill_entry_clear(r->kills + i);
+    }
+
+    free(r);
+}
+
+kill_ring *kill_ring_new() {
+    return (kill_ring *)calloc(1, sizeof(kill_ring));
+}
+
+// the ring takes the kill
+void kill_ring_push(kill_ring *r, kill_entry *k) {
+    r->last = (r->len) ? (r->last + 1) % KILL_RING_SIZE : 0;
+
+    if(r->len == KILL_RING_SIZE) {
+        kill_entry_clear(r->kills + r->last);
+    } else {
+        r->len++;
+    }
+
+    r->kills[r->last] = *k;
+}
+
+// n-th latest kill from 0, NULL if there's none
+kill_entry *kill_ring_get(kill_ring *r, int n) {
+    if(n < 0 || n >= r->len) return NULL;
+
+    return r->kills + (r->last - n + KILL_RING_SIZE) % KILL_RING_SIZE;
+}
+
+#endif
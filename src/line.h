@@ -20,13 +20,21 @@
 #define __UNN_LINE_H_
 
 #include <wchar.h>
+#include <wctype.h>
+
+#include <stdatomic.h>
 
 #include "colors.h"
+#include "grapheme.h"
+#include "width.h"
 
 #define DCHAR_COLORED 1
 #define DCHAR_BOLD 2
 #define DCHAR_ITALIC 4
 #define DCHAR_DIM 8
+#define DCHAR_SYNTAX 16 // foreground is set by the highlighter, see highlight.h
+
+#define LINE_TAB_WIDTH 4
 
 // I'm not sure if this is efficient
 typedef struct dchar {
@@ -63,11 +71,47 @@ inline static dchar *dch_new(wchar_t wch, int flags, rgb_pair color) {
 
 #define DCH(_wch) ((dchar) { .wch = _wch, .flags = 0, .color = RGB_PAIR(0, 0, 0, 0, 0, 0) })
 
+// chars shared by lines and kills instead of being copied, immutable while shared.
+// a line writes to it's chars only after line_own
+typedef struct dchunk {
+    atomic_int refs;
+    int cap;
+    dchar *dchs;
+} dchunk;
+
+void dchunk_unref(dchunk *c) {
+    if(atomic_fetch_sub(&c->refs, 1) != 1) return;
+
+    free(c->dchs);
+    free(c);
+}
+
 typedef struct line {
     struct line *prev, *next;
 
     int len, cap;
     dchar *dstr;
+    dchunk *shared; // dstr is a part of it, NULL if dstr is the line's own
+
+    // display column each char begins at, cols[len] is the line's width.
+    // rebuilt lazily after the line is modified
+    int *cols;
+    int cols_cap;
+    char cols_valid;
+
+    // positions the visual rows begin at when wrapped into rows_width columns,
+    // rows_width is 0 until they're counted. see line_rows_update
+    int *rows;
+    int rows_len, rows_cap, rows_width;
+
+    // positions word motions stop at, see LINE_BOUND_*. rebuilt lazily as well
+    unsigned long long *bounds;
+    int bounds_cap;
+    char bounds_valid;
+
+    // lexer state at the end of the line, see highlight.h
+    int hl_state;
+    char hl_valid; // 0 if the line must be highlighted again, see HL_VALID
 } line;
 
 // cap >= 1
@@ -89,6 +133,19 @@ line *line_empty(int cap) {
         .len = 0,
         .cap = cap,
         .dstr = dstr,
+        .shared = NULL,
+        .cols = NULL,
+        .cols_cap = 0,
+        .cols_valid = 0,
+        .rows = NULL,
+        .rows_len = 0,
+        .rows_cap = 0,
+        .rows_width = 0,
+        .bounds = NULL,
+        .bounds_cap = 0,
+        .bounds_valid = 0,
+        .hl_state = 0,
+        .hl_valid = 0,
     };
 
     return dl;
@@ -97,11 +154,538 @@ line *line_empty(int cap) {
 void line_free(line *dl) {
     if(!dl) return;
     
-    free(dl->dstr);
+    if(dl->shared) {
+        dchunk_unref(dl->shared);
+    } else {
+        free(dl->dstr);
+    }
+
+    if(dl->cols)
+        free(dl->cols);
+
+    if(dl->rows)
+        free(dl->rows);
+
+    if(dl->bounds)
+        free(dl->bounds);
+
     free(dl);
 }
 
+// the chunk the line's chars are in, with a reference for the caller.
+// the line keeps using it until it's modified. returns NULL if not enough memory
+dchunk *line_share(line *dl) {
+    if(!dl->shared) {
+        dchunk *c = (dchunk *)malloc(sizeof(*c));
+
+        if(!c) return NULL;
+
+        atomic_init(&c->refs, 1);
+        c->cap = dl->cap;
+        c->dchs = dl->dstr;
+
+        dl->shared = c;
+    }
+
+    atomic_fetch_add(&dl->shared->refs, 1);
+
+    return dl->shared;
+}
+
+// a line of len chars of the chunk from off, sharing them. returns NULL if not enough memory
+line *line_from_chunk(dchunk *c, int off, int len) {
+    line *dl = line_empty(1);
+
+    if(!dl) return NULL;
+
+    free(dl->dstr);
+
+    atomic_fetch_add(&c->refs, 1);
+
+    dl->dstr = c->dchs + off;
+    dl->len = len;
+    dl->cap = len;
+    dl->shared = c;
+
+    return dl;
+}
+
+// make the line's chars it's own before writing to them, copied unless nothing
+// else shares them anymore. returns -1 if not enough memory
+int line_own(line *dl) {
+    dchunk *c = dl->shared;
+
+    if(!c) return 0;
+
+    if(dl->dstr == c->dchs && atomic_load(&c->refs) == 1) {
+        dl->cap = c->cap;
+        dl->shared = NULL;
+        free(c);
+        return 0;
+    }
+
+    int cap = dl->len + 4;
+    dchar *dstr = (dchar *)malloc(sizeof(*dstr) * cap);
+
+    if(!dstr) return -1;
+
+    memcpy(dstr, dl->dstr, sizeof(*dstr) * dl->len);
+
+    dl->dstr = dstr;
+    dl->cap = cap;
+    dl->shared = NULL;
+
+    dchunk_unref(c);
+
+    return 0;
+}
+
+// cells taken by wch when it begins at col, tabs extend to the next tab stop
+inline static int line_wch_width(wchar_t wch, int col) {
+    if(wch == L'\t') {
+        return LINE_TAB_WIDTH - col % LINE_TAB_WIDTH;
+    }
+
+    return wch_width(wch);
+}
+
+// make dst a copy of src's contents reusing dst's memory, prev and next are left as they are.
+// returns -1 if not enough memory
+int line_copy_to(line *dst, line *src) {
+    if(dst->cap < src->len) {
+        int new_cap = src->len + 16;
+
+        dchar *dstr = (dchar *)realloc(dst->dstr, sizeof(*dstr) * new_cap);
+
+        if(!dstr) return -1;
+
+        dst->dstr = dstr;
+        dst->cap = new_cap;
+    }
+
+    if(src->len)
+        memcpy(dst->dstr, src->dstr, sizeof(*src->dstr) * src->len);
+
+    dst->len = src->len;
+    dst->cols_valid = 0;
+    dst->bounds_valid = 0;
+
+    if(src->cols_valid) { // no need to count the columns again
+        if(dst->cols_cap < src->len + 1) {
+            int *cols = (int *)realloc(dst->cols, sizeof(*cols) * (src->len + 1));
+
+            if(!cols) return 0; // they are counted when needed
+
+            dst->cols = cols;
+            dst->cols_cap = src->len + 1;
+        }
+
+        memcpy(dst->cols, src->cols, sizeof(*src->cols) * (src->len + 1));
+        dst->cols_valid = 1;
+    }
+
+    dst->rows_width = 0;
+
+    if(src->rows_width && dst->cols_valid) { // the wrapped rows as well
+        if(dst->rows_cap < src->rows_len) {
+            int *rows = (int *)realloc(dst->rows, sizeof(*rows) * src->rows_len);
+
+            if(!rows) return 0;
+
+            dst->rows = rows;
+            dst->rows_cap = src->rows_len;
+        }
+
+        memcpy(dst->rows, src->rows, sizeof(*src->rows) * src->rows_len);
+        dst->rows_len = src->rows_len;
+        dst->rows_width = src->rows_width;
+    }
+
+    dst->hl_state = src->hl_state;
+    dst->hl_valid = src->hl_valid;
+
+    return 0;
+}
+
+// must be called after every modification of the line's contents
+inline static void line_changed(line *dl) {
+    dl->cols_valid = 0;
+    dl->rows_width = 0;
+    dl->bounds_valid = 0;
+    dl->hl_valid = 0;
+}
+
+// returns -1 if not enough memory
+int line_cols_update(line *dl) {
+    if(dl->cols_valid) return 0;
+
+    if(dl->cols_cap < dl->len + 1) {
+        int new_cap = dl->len + 1 + 16;
+
+        int *cols = (int *)realloc(dl->cols, sizeof(*cols) * new_cap);
+
+        if(!cols) return -1;
+
+        dl->cols = cols;
+        dl->cols_cap = new_cap;
+    }
+
+    int col = 0;
+
+    for(int i = 0; i < dl->len; i++) {
+        dl->cols[i] = col;
+        col += line_wch_width(dl->dstr[i].wch, col);
+    }
+
+    dl->cols[dl->len] = col;
+    dl->cols_valid = 1;
+
+    return 0;
+}
+
+// display column the char at pos begins at, pos <= len
+inline static int line_col(line *dl, int pos) {
+    if(pos <= 0) return 0;
+    if(pos > dl->len) pos = dl->len;
+
+    if(line_cols_update(dl)) return pos; // no memory, assume narrow chars
+
+    return dl->cols[pos];
+}
+
+inline static int line_width(line *dl) {
+    return line_col(dl, dl->len);
+}
+
+// the first position that begins at col or after it, len if there's none
+int line_pos_at_col(line *dl, int col) {
+    if(col <= 0) return 0;
+
+    if(line_cols_update(dl)) { // no memory, assume narrow chars
+        return (col < dl->len) ? col : dl->len;
+    }
+
+    int lo = 0, hi = dl->len;
+
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if(dl->cols[mid] < col) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+// position of the char covering col, len if col is past the line's end
+inline static int line_pos_in_col(line *dl, int col) {
+    if(col >= line_width(dl)) return dl->len;
+
+    int pos = line_pos_at_col(dl, col + 1);
+
+    return (pos > 0) ? pos - 1 : 0;
+}
+
+// the position after the last char from pos that fits into the given width
+inline static int line_pos_fit(line *dl, int pos, int width) {
+    int limit = line_col(dl, pos) + width;
+    int end = line_pos_at_col(dl, limit + 1);
+
+    if(end > pos && line_col(dl, end) > limit) {
+        end--;
+    }
+
+    return end;
+}
+
+// the first position of the visual row after the one beginning at pos, -1 if it's the last one.
+// a row ends before the first char that doesn't fit into tw columns, so that a wide char
+// or a tab crossing the row's end begins the next one. there's always a row for the position
+// after the last char, a char wider than a whole row takes one for itself
+inline static int line_row_next(line *dl, int tw, int pos) {
+    if(line_width(dl) - line_col(dl, pos) < tw) return -1; // with a column left for the cursor
+
+    int next = line_pos_fit(dl, pos, tw);
+
+    return (next > pos) ? next : pos + 1;
+}
+
+// count the visual rows of the line wrapped into tw columns unless they are already,
+// so that only modified lines are reflowed. returns -1 if not enough memory
+int line_rows_update(line *dl, int tw) {
+    if(dl->rows_width == tw && dl->cols_valid) return 0;
+    if(line_cols_update(dl)) return -1;
+
+    int len = 0;
+
+    for(int pos = 0; pos >= 0; pos = line_row_next(dl, tw, pos)) {
+        if(len == dl->rows_cap) {
+            int new_cap = dl->rows_cap * 2 + 4;
+
+            int *rows = (int *)realloc(dl->rows, sizeof(*rows) * new_cap);
+
+            if(!rows) return -1;
+
+            dl->rows = rows;
+            dl->rows_cap = new_cap;
+        }
+
+        dl->rows[len++] = pos;
+    }
+
+    dl->rows_len = len;
+    dl->rows_width = tw;
+
+    return 0;
+}
+
+#define LINE_BOUND_WORD 0 // beginning of a run of non-space chars
+#define LINE_BOUND_TOKEN 1 // beginning of a run of word chars or of other non-space chars
+#define LINE_BOUND_SUBWORD 2 // beginning of a token or of a part of a word: camelCase, snake_case, 42px
+#define LINE_BOUND_GRAPHEME 3 // beginning of a grapheme cluster: a char with it's combining marks, an emoji sequence
+#define LINE_BOUNDS 4
+
+inline static int _line_bounds_words(int len) {
+    return len / 64 + 1;
+}
+
+// classes of 64 chars from the block's beginning, a bit per char
+typedef struct _line_block {
+    unsigned long long space, word, upper, digit, under;
+} _line_block;
+
+#define _LINE_CLS_SPACE 1
+#define _LINE_CLS_WORD 2
+#define _LINE_CLS_UPPER 4
+#define _LINE_CLS_DIGIT 8
+#define _LINE_CLS_UNDER 16
+#define _LINE_CLS_OTHER 32 // past ascii
+
+// a bit of each of the 8 bytes, the 8 chars' class bits into a byte
+inline static unsigned long long _line_cls_pack(unsigned long long bytes, int cls) {
+    int shift = __builtin_ctz(cls);
+
+    return (((bytes >> shift) & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56;
+}
+
+inline static _line_block _line_classify(line *dl, int block) {
+    _line_block m = { 0 };
+    unsigned char cls[64] = { 0 };
+
+    int from = block * 64;
+    int n = dl->len - from;
+
+    if(n > 64) n = 64;
+
+    dchar *dchs = dl->dstr + from;
+
+    // ascii classes into a byte per char, branch-free with no calls so that it's vectorized
+    for(int i = 0; i < n; i++) {
+        unsigned int wch = (unsigned int)dchs[i].wch;
+
+        unsigned char ascii = (wch < 128);
+        unsigned char alpha = ((wch | 32) - 'a' < 26);
+        unsigned char digit = (wch - '0' < 10);
+        unsigned char under = (wch == '_');
+        unsigned char space = (wch == ' ') | (wch - 9 < 5);
+
+        cls[i] = space * _LINE_CLS_SPACE
+            | (ascii & (alpha | digit | under)) * _LINE_CLS_WORD
+            | (wch - 'A' < 26) * _LINE_CLS_UPPER
+            | digit * _LINE_CLS_DIGIT
+            | under * _LINE_CLS_UNDER
+            | (ascii ^ 1) * _LINE_CLS_OTHER;
+    }
+
+    unsigned long long other = 0;
+
+    // the bytes into the bit masks, 8 chars at a time
+    for(int g = 0; g < 8; g++) {
+        unsigned long long bytes;
+        memcpy(&bytes, cls + g * 8, sizeof(bytes));
+
+        m.space |= _line_cls_pack(bytes, _LINE_CLS_SPACE) << (g * 8);
+        m.word |= _line_cls_pack(bytes, _LINE_CLS_WORD) << (g * 8);
+        m.upper |= _line_cls_pack(bytes, _LINE_CLS_UPPER) << (g * 8);
+        m.digit |= _line_cls_pack(bytes, _LINE_CLS_DIGIT) << (g * 8);
+        m.under |= _line_cls_pack(bytes, _LINE_CLS_UNDER) << (g * 8);
+        other |= _line_cls_pack(bytes, _LINE_CLS_OTHER) << (g * 8);
+    }
+
+    // the rest goes through the locale, one char at a time
+    for(; other; other &= other - 1) {
+        int i = __builtin_ctzll(other);
+        wchar_t wch = dchs[i].wch;
+        unsigned long long bit = 1ULL << i;
+
+        if(iswspace(wch)) m.space |= bit;
+        if(iswalnum(wch)) m.word |= bit;
+        if(iswupper(wch)) m.upper |= bit;
+    }
+
+    return m;
+}
+
+// returns -1 if not enough memory
+int line_bounds_update(line *dl) {
+    if(dl->bounds_valid) return 0;
+
+    int words = _line_bounds_words(dl->len);
+
+    if(dl->bounds_cap < words * LINE_BOUNDS) {
+        unsigned long long *bounds = (unsigned long long *)realloc(dl->bounds,
+            sizeof(*bounds) * words * LINE_BOUNDS);
+
+        if(!bounds) return -1;
+
+        dl->bounds = bounds;
+        dl->bounds_cap = words * LINE_BOUNDS;
+    }
+
+    unsigned long long *word_bits = dl->bounds;
+    unsigned long long *token_bits = dl->bounds + words;
+    unsigned long long *sub_bits = dl->bounds + words * 2;
+
+    // the line begins as if after a space
+    _line_block prev = { .space = 1ULL << 63 };
+    _line_block m = _line_classify(dl, 0);
+
+    for(int b = 0; b < words; b++) {
+        _line_block next = (b + 1 < words) ? _line_classify(dl, b + 1) : (_line_block) { 0 };
+
+        // the same classes of each char's previous and next ones
+        unsigned long long p_space = (m.space << 1) | (prev.space >> 63);
+        unsigned long long p_word = (m.word << 1) | (prev.word >> 63);
+        unsigned long long p_upper = (m.upper << 1) | (prev.upper >> 63);
+        unsigned long long p_digit = (m.digit << 1) | (prev.digit >> 63);
+        unsigned long long p_under = (m.under << 1) | (prev.under >> 63);
+
+        unsigned long long lower = m.word & ~m.upper & ~m.digit & ~m.under;
+        unsigned long long p_lower = p_word & ~p_upper & ~p_digit & ~p_under;
+        unsigned long long n_lower = (lower >> 1) | ((next.word & ~next.upper & ~next.digit & ~next.under) << 63);
+
+        unsigned long long word = ~m.space & p_space;
+        unsigned long long token = ~m.space & (p_space | (m.word ^ p_word));
+
+        unsigned long long part = m.word & ~m.under & p_word; // inside a word, not the underscores
+        unsigned long long sub = token
+            | (part & p_under)
+            | (part & ~p_under & (m.digit ^ p_digit))
+            | (m.upper & p_lower)
+            | (m.upper & p_upper & n_lower);
+
+        // no bits past the line's end
+        int n = dl->len - b * 64;
+        unsigned long long valid = (n >= 64) ? ~0ULL : (1ULL << n) - 1;
+
+        word_bits[b] = word & valid;
+        token_bits[b] = token & valid;
+        sub_bits[b] = sub & valid;
+
+        prev = m;
+        m = next;
+    }
+
+    // clusters need the rules' state carried from char to char, see grapheme.h
+    unsigned long long *grapheme_bits = dl->bounds + words * 3;
+    gcb_state s = GCB_STATE_START;
+
+    memset(grapheme_bits, 0, sizeof(*grapheme_bits) * words);
+
+    for(int i = 0; i < dl->len; i++) {
+        if(gcb_step(&s, gcb_prop(dl->dstr[i].wch))) {
+            grapheme_bits[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+
+    dl->bounds_valid = 1;
+
+    return 0;
+}
+
+// the first boundary of the kind after pos, -1 if there's none
+int line_bound_next(line *dl, int kind, int pos) {
+    int from = (pos < 0) ? 0 : pos + 1;
+
+    if(from >= dl->len) return -1;
+    if(line_bounds_update(dl)) return -1;
+
+    int words = _line_bounds_words(dl->len);
+    unsigned long long *bits = dl->bounds + kind * words;
+
+    int w = from / 64;
+    unsigned long long m = bits[w] & (~0ULL << (from % 64));
+
+    while(!m) {
+        if(++w == words) return -1;
+        m = bits[w];
+    }
+
+    return w * 64 + __builtin_ctzll(m);
+}
+
+// the last boundary of the kind before pos, -1 if there's none
+int line_bound_prev(line *dl, int kind, int pos) {
+    int to = (pos > dl->len) ? dl->len - 1 : pos - 1;
+
+    if(to < 0) return -1;
+    if(line_bounds_update(dl)) return -1;
+
+    int words = _line_bounds_words(dl->len);
+    unsigned long long *bits = dl->bounds + kind * words;
+
+    int w = to / 64;
+    unsigned long long m = bits[w] & (~0ULL >> (63 - to % 64));
+
+    while(!m) {
+        if(--w < 0) return -1;
+        m = bits[w];
+    }
+
+    return w * 64 + 63 - __builtin_clzll(m);
+}
+
+// a cluster always begins between two printable ascii chars
+inline static char _line_ascii_pair(line *dl, int pos) {
+    return dl->dstr[pos].wch >= 0x20 && dl->dstr[pos].wch < 0x7f &&
+        dl->dstr[pos + 1].wch >= 0x20 && dl->dstr[pos + 1].wch < 0x7f;
+}
+
+// the position after the cluster at pos, len at most
+inline static int line_grapheme_next(line *dl, int pos) {
+    if(pos >= dl->len) return dl->len;
+    if(pos + 1 == dl->len || _line_ascii_pair(dl, pos)) return pos + 1; // without the cache
+    if(line_bounds_update(dl)) return pos + 1; // no memory, a char per cluster
+
+    int next = line_bound_next(dl, LINE_BOUND_GRAPHEME, pos);
+
+    return (next < 0) ? dl->len : next;
+}
+
+// the beginning of the cluster before pos, 0 at least
+inline static int line_grapheme_prev(line *dl, int pos) {
+    if(pos <= 0) return 0;
+    if(pos > dl->len) pos = dl->len;
+    if(pos == 1 || _line_ascii_pair(dl, pos - 2)) return pos - 1;
+    if(line_bounds_update(dl)) return pos - 1;
+
+    int prev = line_bound_prev(dl, LINE_BOUND_GRAPHEME, pos);
+
+    return (prev < 0) ? 0 : prev;
+}
+
+// the beginning of the cluster pos is in
+inline static int line_grapheme_start(line *dl, int pos) {
+    if(pos <= 0 || pos >= dl->len) return pos;
+
+    return line_grapheme_prev(dl, pos + 1);
+}
+
 inline static int _line_check(line *dl, int amount) {
+    if(line_own(dl)) return -1;
     if((dl->len + amount) <= dl->cap) return 0;
 
     int new_cap = dl->cap * 2;
@@ -129,6 +713,8 @@ int line_insert(line *dl, dchar ch, int index) {
     dl->dstr[index] = ch;
     dl->len++;
 
+    line_changed(dl);
+
     return 0;
 }
 
@@ -140,12 +726,15 @@ int line_insert_multi(line *dl, dchar *dbuff, int len, int index) {
     int to_move = dl->len - index;
 
     if(to_move)
-        memmove(dl->dstr + index + 1, dl->dstr + index, sizeof(*dl->dstr) * to_move);
+        memmove(dl->dstr + index + len, dl->dstr + index, sizeof(*dl->dstr) * to_move);
 
-    memcpy(dl->dstr + index, dbuff, sizeof(*dbuff) * len);
+    if(len)
+        memcpy(dl->dstr + index, dbuff, sizeof(*dbuff) * len);
 
     dl->len += len;
 
+    line_changed(dl);
+
     return 0;
 }
 
@@ -172,6 +761,8 @@ int line_insert_wcs(line *l, wchar_t *wcs, int idx) {
 
     l->len = new_len;
 
+    line_changed(l);
+
     return 0;
 }
 
@@ -185,6 +776,7 @@ inline static int line_append_multi(line *dl, dchar *dchs, int len) {
 
 int line_remove(line *dl, int index, dchar *buff) {
     if(!dl) return -1;
+    if(line_own(dl)) return -2;
 
     dchar ch = dl->dstr[index];
 
@@ -195,6 +787,8 @@ int line_remove(line *dl, int index, dchar *buff) {
 
     dl->len--;
 
+    line_changed(dl);
+
     if(buff)
         *buff = ch;
 
@@ -206,10 +800,12 @@ int line_remove_multi(line *dl, int index, int amount, dchar *buff) {
 
     if(buff) {
         for(int i = index; i < index + amount; i++) {
-            *buff = dl->dstr[i];
+            buff[i - index] = dl->dstr[i];
         }
     }
 
+    if(line_own(dl)) return -2;
+
     int to_move = sizeof(*dl->dstr) * (dl->len - index - amount);
 
     if(to_move)
@@ -217,6 +813,8 @@ int line_remove_multi(line *dl, int index, int amount, dchar *buff) {
 
     dl->len -= amount;
 
+    line_changed(dl);
+
     return 0;
 }
 
@@ -26,6 +26,7 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "state.h"
 #include "draw.h"
@@ -69,43 +70,53 @@ inline static int state_flag_is_off(int f) {
     return !state_flag_is_on(f);
 }
 
-#define FLAG_DRAW_WINDOW 1
 #define FLAG_DRAW_STATUS 2
 #define FLAG_DRAW_GRID 4
 #define FLAG_DRAW_ALL 8
+#define FLAG_DRAW_FRAME 16 // only render the already drawn planes
 
-inline static void order_draw(int f) {
-    pthread_mutex_lock(&S.draw_flags_block);
+// wake the draw loop, unless the input loop holds it back (see draw_hold)
+inline static void _draw_request_post() {
+    if(atomic_load(&S.draw_hold)) {
+        atomic_store(&S.draw_deferred, 1);
 
-    S.draw_flags |= f;
+        if(atomic_load(&S.draw_hold)) return; // draw_release posts it
+    }
 
     int val;
     sem_getvalue(&S.draw_request, &val);
 
     if(!val) sem_post(&S.draw_request);
+}
+
+inline static void order_draw(int f) {
+    pthread_mutex_lock(&S.draw_flags_block);
+
+    S.draw_flags |= f;
+
+    _draw_request_post();
 
     pthread_mutex_unlock(&S.draw_flags_block);
 }
 
+// lock-free, so that any number of windows can be ordered from any thread.
+// the draw loop finds ordered windows by their draw_pending
 inline static void order_draw_window(window *w) {
-    pthread_mutex_lock(&S.draw_flags_block);
+    if(!w) return;
 
-    for(int i = 0; i < S.draw_windows_count; i++) {  // bad
-        if(S.draw_windows[i] == w) {
-            pthread_mutex_unlock(&S.draw_flags_block);
-            return;
-        }
-    }
+    buffer *b = w->buff;
 
-    S.draw_windows[S.draw_windows_count++] = w;
-    S.draw_flags |= FLAG_DRAW_WINDOW;
+    if(b && atomic_load(&b->tx_depth)) {
+        atomic_store(&b->tx_draw, 1);
 
-    int val;
-    sem_getvalue(&S.draw_request, &val);
+        if(atomic_load(&b->tx_depth)) return; // buffer_commit orders it
+    }
 
-    if(!val) sem_post(&S.draw_request);
+    if(atomic_exchange(&w->draw_pending, 1)) return; // already ordered
 
-    pthread_mutex_unlock(&S.draw_flags_block);
+    atomic_store(&S.draw_windows_pending, 1);
+
+    _draw_request_post();
 }
 
 inline static void order_draw_status() {
@@ -120,96 +131,292 @@ inline static void order_draw_all() {
     return order_draw(FLAG_DRAW_ALL);
 }
 
+void order_highlight() {
+    int val;
+    sem_getvalue(&S.highlight_request, &val);
+
+    if(!val) sem_post(&S.highlight_request);
+}
+
 #include "helpers.h"
 
+// microseconds passed since the given monotonic clock time point
+inline static long elapsed_us(struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+// let the draw requests ordered since draw_hold through
+inline static void draw_release() {
+    if(!atomic_load(&S.draw_hold)) return;
+
+    edits_release(); // their draws are merged into the released ones
+
+    atomic_store(&S.draw_hold, 0);
+
+    if(atomic_exchange(&S.draw_deferred, 0)) {
+        int val;
+        sem_getvalue(&S.draw_request, &val);
+
+        if(!val) sem_post(&S.draw_request);
+    }
+}
+
+// hold the draw requests back while queued keys are applied, so that they
+// are drawn once. a frame is still let through every S.frame_budget.
+// the edits are held as well, see edits_hold
+inline static void draw_hold() {
+    if(atomic_load(&S.draw_hold)) {
+        if(elapsed_us(&S.draw_hold_start) < S.frame_budget) return;
+
+        draw_release();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &S.draw_hold_start);
+    atomic_store(&S.draw_hold, 1);
+
+    edits_hold();
+}
+
+// if the last frame was drawn less than S.frame_budget ago, wait for the rest of it,
+// all the draw requests ordered meanwhile are merged into the upcoming frame.
+// the first request after idling is drawn without any delay
+inline static void draw_wait_frame_budget(struct timespec *last_frame) {
+    long left = S.frame_budget - elapsed_us(last_frame);
+
+    if(left <= 0) return;
+
+    struct timespec ts = {
+        .tv_sec = left / 1000000,
+        .tv_nsec = (left % 1000000) * 1000,
+    };
+
+    nanosleep(&ts, NULL);
+
+    // requests' flags are already accumulated in S.draw_flags
+    while(!sem_trywait(&S.draw_request));
+}
+
+// render the drawn planes into a frame and pass it to the raster loop.
+// if the raster loop is still writing the previous frame, this one is dropped
+// and the raster loop orders a new one as soon as it's done
+// must be called with S.draw_block locked
+inline static void present_frame() {
+    if(pthread_mutex_trylock(&S.raster_block)) {
+        pthread_mutex_lock(&S.raster_flags_block);
+        S.raster_missed = 1;
+        pthread_mutex_unlock(&S.raster_flags_block);
+
+        // the raster loop reads raster_missed after freeing the block. if it's free now,
+        // raster_missed might have been read before it was set, so the frame isn't dropped
+        if(pthread_mutex_trylock(&S.raster_block)) {
+            logg("Frame dropped, raster is busy\n");
+            return;
+        }
+
+        pthread_mutex_lock(&S.raster_flags_block);
+        S.raster_missed = 0;
+        pthread_mutex_unlock(&S.raster_flags_block);
+    }
+
+    ncpile_render(S.p);
+
+    pthread_mutex_unlock(&S.raster_block);
+
+    int val;
+    sem_getvalue(&S.raster_request, &val);
+
+    if(!val) sem_post(&S.raster_request);
+}
+
+// writes rendered frames to the terminal, so that slow terminals
+// don't hold up drawing of the next frames
+void *raster_loop(void*) {
+    while (1) {
+        sem_wait(&S.raster_request);
+
+        if(state_flag_is_on(FLAG_EXIT)) {
+            break;
+        }
+
+        pthread_mutex_lock(&S.raster_block);
+
+        ncpile_rasterize(S.p);
+
+        pthread_mutex_unlock(&S.raster_block);
+
+        // read once the block is free, see present_frame
+        pthread_mutex_lock(&S.raster_flags_block);
+        char missed = S.raster_missed;
+        S.raster_missed = 0;
+        pthread_mutex_unlock(&S.raster_flags_block);
+
+        if(missed) {
+            order_draw(FLAG_DRAW_FRAME);
+        }
+    }
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// highlights buffers in the background step by step (see highlight_work),
+// buffer's block is only held for a single step so that editing and drawing aren't held up
+void *highlight_loop(void*) {
+    while (1) {
+        sem_wait(&S.highlight_request);
+
+        char pending = 1;
+
+        while(pending && state_flag_is_off(FLAG_EXIT)) {
+            pending = 0;
+
+            pthread_mutex_lock(&S.highlight_block);
+
+            for(buffer *b = S.blist->first; b != NULL; b = b->next) {
+                if(!b->syn) continue;
+
+                char publish;
+
+                pthread_mutex_lock(&b->block);
+
+                if(highlight_work(b, &publish)) {
+                    pending = 1;
+                }
+
+                pthread_mutex_unlock(&b->block);
+
+                if(publish) {
+                    order_draw_grid();
+                }
+            }
+
+            pthread_mutex_unlock(&S.highlight_block);
+        }
+
+        if(state_flag_is_on(FLAG_EXIT)) {
+            break;
+        }
+    }
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// draw the window if it was ordered, returns not 0 if it was drawn
+inline static int _draw_pending_window(window *w) {
+    if(!atomic_exchange(&w->draw_pending, 0)) return 0;
+
+    draw_window_snapshot(w);
+
+    return 1;
+}
+
+// draw windows ordered by order_draw_window, only the grid's and the prompt's
+// windows are checked, so destroyed windows are never drawn
+int draw_pending_windows() {
+    int count = 0;
+
+    for(window *w = S.grid->first; w != NULL; w = w->next) {
+        count += _draw_pending_window(w);
+    }
+
+    if(S.prompt_window) {
+        count += _draw_pending_window(S.prompt_window);
+    }
+
+    return count;
+}
+
 void *draw_loop(void*) {
+    struct timespec frame_start = { 0 };
+
     while (1) {
         if(state_flag_is_on(FLAG_EXIT)) {
+            sem_post(&S.raster_request); // let the raster and highlight loops exit too
+            sem_post(&S.highlight_request);
             break;
         }
 
         sem_wait(&S.draw_request);
 
+        draw_wait_frame_budget(&frame_start);
+
         logg("Drawing...\n");
 
+        clock_gettime(CLOCK_MONOTONIC, &frame_start);
+        draw_cells = 0;
+
         pthread_mutex_lock(&S.draw_block);
         pthread_mutex_lock(&S.draw_flags_block);
 
         char d_a = flag_is_on(S.draw_flags, FLAG_DRAW_ALL);
         char d_g = flag_is_on(S.draw_flags, FLAG_DRAW_GRID);
-        char d_w = flag_is_on(S.draw_flags, FLAG_DRAW_WINDOW);
+        char d_w = atomic_exchange(&S.draw_windows_pending, 0);
         char d_s = flag_is_on(S.draw_flags, FLAG_DRAW_STATUS);
+        char d_f = flag_is_on(S.draw_flags, FLAG_DRAW_FRAME);
         S.draw_flags = 0;
 
-        logg("Draw flags: a%d g%d w%d s%d\n",
-        d_a, d_g, d_w, d_s);
+        logg("Draw flags: a%d g%d w%d s%d f%d\n",
+        d_a, d_g, d_w, d_s, d_f);
 
-        if(d_a || d_g) {
-            S.draw_windows_count = 0;
-        } else if(d_w) {
-            S.draw_windows_count2 = S.draw_windows_count;
-            S.draw_windows_count = 0;
+        pthread_mutex_unlock(&S.draw_flags_block);
 
-            window **tmp = S.draw_windows;
-            S.draw_windows = S.draw_windows2;
-            S.draw_windows2 = tmp;
+        if(d_a || d_g) { // all the grid's windows are drawn anyway
+            for(window *w = S.grid->first; w != NULL; w = w->next) {
+                atomic_store(&w->draw_pending, 0);
+            }
         }
 
-        pthread_mutex_unlock(&S.draw_flags_block);
-
         if(d_a) {
             ncplane_erase(S.p);
-            draw_grid(S.p, S.grid, 0);
-            if(S.prompt_window) draw_window(S.prompt_window);
+
+            for(window *w = S.grid->first; w != NULL; w = w->next) {
+                window_drawn_invalidate(w);
+            }
+            window_drawn_invalidate(S.prompt_window);
+            if(S.prompt_window) atomic_store(&S.prompt_window->draw_pending, 0);
+            status_invalidate();
+
+            draw_grid(S.p, S.grid);
+            if(S.prompt_window) draw_window_snapshot(S.prompt_window);
             draw_status(S.p);
 
-            notcurses_render(S.nc);
+            present_frame();
             pthread_mutex_unlock(&S.draw_block);
 
-            logg("Drawn: all\n");
+            logg("Drawn: all (%ld us, %ld cells)\n", elapsed_us(&frame_start), draw_cells);
 
             continue;
         }    
 
         if(d_s) {
             draw_status(S.p);
-            logg("Drawn: status\n");
+            logg("Drawn: status (%ld cells)\n", draw_cells);
         }
 
         if(d_g) {
-            draw_grid(S.p, S.grid, 0);
+            draw_grid(S.p, S.grid);
+            draw_pending_windows(); // the prompt
 
-            notcurses_render(S.nc);
+            present_frame();
             pthread_mutex_unlock(&S.draw_block);
             
-            logg("Drawn: grid\n");
+            logg("Drawn: grid (%ld us, %ld cells)\n", elapsed_us(&frame_start), draw_cells);
             continue;
         }
 
         if(d_w) {
-            for(int i = 0; i < S.draw_windows_count2; i++) {
-                window *w = S.draw_windows2[i];
-                if(pthread_mutex_trylock(&w->buff->block)) continue;
-
-                buffer *b = w->buff;
-                if(b) {
-                    draw_func draw = b->draw;
-                    if(draw) {
-                        draw(w);
-                    }
-                } else {
-                    draw_window(w);
-                }
+            draw_pending_windows();
 
-                pthread_mutex_unlock(&w->buff->block);
-            }
-
-            notcurses_render(S.nc);
+            present_frame();
             pthread_mutex_unlock(&S.draw_block);
             
-            logg("Drawn: windows\n");
-        } else if(d_s) {
-            notcurses_render(S.nc);
+            logg("Drawn: windows (%ld us, %ld cells)\n", elapsed_us(&frame_start), draw_cells);
+        } else if(d_s || d_f) {
+            present_frame();
             pthread_mutex_unlock(&S.draw_block);
         } else {
             pthread_mutex_unlock(&S.draw_block);
@@ -239,7 +446,9 @@ void grid_fit_full() {
 
     // this works for some reason, maybe notcurses
     // resizes it's planes after this call?
+    pthread_mutex_lock(&S.raster_block);
     notcurses_refresh(S.nc, &max_y, &max_x);
+    pthread_mutex_unlock(&S.raster_block);
 
     logg("New height, width: %d %d\n", max_y, max_x);
 
@@ -276,10 +485,105 @@ void on_resize() {
 }
 
 void _process_edit(wchar_t wch);
+void buffer_erase_at_cursor();
+
+// the state's binds with the buffer's ones over them, merged once they change
+inline static binds *_input_binds(char is_edit) {
+    binds *state_binds = (is_edit) ? S.binds_edit : S.binds_move;
+    buffer *buff = (S.current_window) ? S.current_window->buff : NULL;
+
+    if(!buff) return state_binds;
+
+    binds *layers[2] = { state_binds, (is_edit) ? buff->edit_binds : buff->move_binds };
+    binds *merged = binds_layered_get(&buff->binds_cache[(int)is_edit], layers, 2);
+
+    return (merged) ? merged : state_binds; // no memory, the buffer's binds are left out
+}
+
+// step the node by the keys, returns what is bound after them.
+// count is set to the BIND_COUNT_* of the bound command, it may be NULL
+inline static tusk _input_step(int *node, char *keys, int n, char is_edit, char *count) {
+    binds *b = _input_binds(is_edit);
+
+    for(int i = 0; i < n; i++) {
+        *node = binds_step(b, *node, keys[i]);
+    }
+
+    if(count) *count = binds_node_count(b, *node);
+
+    return binds_node_cb(b, *node);
+}
+
+inline static tusk _input_binds_get(char *seq, char is_edit) {
+    int node = 0;
+
+    return _input_step(&node, seq, strlen(seq), is_edit, NULL);
+}
+
+// forget the current keybind input
+inline static void input_reset() {
+    S.input_buffer[0] = 0;
+    S.input_buffer_len = 0;
+    S.input_node = 0;
+    S.input_count = 0;
+}
+
+#define INPUT_COUNT_MAX 999999
+
+// digits typed in the move mode before a sequence make it's count, "250m".
+// returns not 0 if the key was taken as a digit of the count
+inline static char _input_count(char key, char is_edit) {
+    if(is_edit) return 0;
+    if(key < '0' || key > '9') return 0;
+    if(key == '0' && !S.input_count) return 0;
+    if(S.input_node) return 0; // in the middle of a sequence
+
+    int node = 0;
+    if(_input_step(&node, &key, 1, is_edit, NULL)) return 0; // the digit is bound itself
+
+    S.input_count = S.input_count * 10 + (key - '0');
+
+    if(S.input_count > INPUT_COUNT_MAX) S.input_count = INPUT_COUNT_MAX;
+
+    return 1;
+}
+
+
+// record the key while a macro is being recorded.
+// the recording stops if there is no memory for it, without the unfinished sequence
+inline static void macro_record(wchar_t wch1, unsigned modifiers, wchar_t wch2) {
+    if(!S.macro_recording || S.macro_playing) return;
+
+    int result = macro_append(S.macro, (macro_key) {
+        .wch1 = wch1,
+        .wch2 = wch2,
+        .modifiers = modifiers,
+    });
+
+    if(result) {
+        S.macro_recording = 0;
+        if(S.input_buffer_len) S.macro->len = S.macro_seq_start;
+
+        status_set_message(L"| Not enough memory, macro of %d keys recorded", S.macro->len);
+    }
+}
 
 inline static void _process_input(ncinput *in, wchar_t wch1, ncinput *in2, wchar_t wch2) {
-    char ch1 = (wch1 > 255) ? '?' : (char)wch1;
-    char ch2 = (wch2 > 255) ? '?' : (char)wch2;
+    if(!S.input_buffer_len) S.macro_seq_start = S.macro->len;
+
+    macro_record(wch1, in->modifiers, wch2);
+
+    char is_edit = state_flag_is_on(FLAG_EDIT);
+
+    // text that doesn't begin any sequence, the most of the typing
+    if(is_edit && !wch2 && !S.input_buffer_len && !ncinput_ctrl_p(in) &&
+        (wch1 >= BINDS_KEYS || binds_step(_input_binds(1), 0, binds_key(wch1)) < 0)) {
+        _process_edit(wch1);
+        return;
+    }
+
+    char ch1 = binds_key(wch1);
+    char ch2 = (wch2) ? binds_key(wch2) : 0;
 
     if(ch2) {
         if(ch1 > ch2) {
@@ -289,68 +593,52 @@ inline static void _process_input(ncinput *in, wchar_t wch1, ncinput *in2, wchar
         }
     }
 
+    char keys[4];
+    int n = 0;
+
     if(ch2) { // modifiers not supported for sim's
-        S.input_buffer[S.input_buffer_len++] = '(';
-        S.input_buffer[S.input_buffer_len++] = ch1;
-        S.input_buffer[S.input_buffer_len++] = ch2;
-        S.input_buffer[S.input_buffer_len++] = ')';
+        keys[n++] = BINDS_CHORD_OPEN;
+        keys[n++] = ch1;
+        keys[n++] = ch2;
+        keys[n++] = BINDS_CHORD_CLOSE;
     } else {
         if(ncinput_ctrl_p(in)) {
-            S.input_buffer[S.input_buffer_len++] = '^';
-            S.input_buffer[S.input_buffer_len++] = towlower(wch1);
+            keys[n++] = '^';
+            keys[n++] = towlower(wch1);
         } else {
-            S.input_buffer[S.input_buffer_len++] = ch1;
+            keys[n++] = ch1;
         }
     }
 
-    S.input_buffer[S.input_buffer_len] = 0;
+    char is_first = !S.input_buffer_len;
 
-    char is_edit = state_flag_is_on(FLAG_EDIT);
+    // the input is only kept for the status, long sequences are cut
+    for(int i = 0; i < n && S.input_buffer_len < sizeof(S.input_buffer) - 1; i++) {
+        S.input_buffer[S.input_buffer_len++] = binds_key_shown(keys[i]);
+    }
 
-    buffer *buff = (S.current_window) ? S.current_window->buff : NULL;
+    S.input_buffer[S.input_buffer_len] = 0;
 
-    binds *binds;
-    tusk att;
-
-    if(!is_edit) { 
-        binds = (buff) ? ((buff->move_binds) ? buff->move_binds : NULL) : NULL;
-        if(!binds) { 
-            att = binds_get(S.binds_move, S.input_buffer);
-        } else { // check if buffer binds override the state's one
-            att = binds_get(binds, S.input_buffer);
-            if(!att) {
-                att = binds_get(S.binds_move, S.input_buffer);
-            }
-        }
-    } else {
-        binds = (buff) ? ((buff->edit_binds) ? buff->edit_binds : NULL) : NULL;
-        if(!binds) {
-            att = binds_get(S.binds_edit, S.input_buffer);
-        } else {
-            att = binds_get(binds, S.input_buffer);
-            if(!att) {
-                att = binds_get(S.binds_edit, S.input_buffer);
-            }
-        }
+    if(n == 1 && _input_count(keys[0], is_edit)) {
+        order_draw_status();
+        return;
+    }
 
-        if(!att && !wch2 && (S.input_buffer_len == 1)) {
+    char count_use;
+    tusk att = _input_step(&S.input_node, keys, n, is_edit, &count_use);
+
+    if(is_edit) {
+        if(!att && !wch2 && is_first && n == 1) {
             _process_edit(wch1);
-            S.input_buffer[0] = 0;
-            S.input_buffer_len = 0;
+            input_reset();
             return;
         }
     }
 
     if(!att || att == TUSK_NOP) {
-        for(int i = 0; i < S.input_buffer_len; i++) {
-            if(!isprint(S.input_buffer[i])) {
-                S.input_buffer[i] = '?';
-            }
-        }
         status_set_message(L"| Unknown command <%s>", S.input_buffer);
 
-        S.input_buffer[0] = 0;
-        S.input_buffer_len = 0;
+        input_reset();
 
         return;
     }
@@ -360,67 +648,359 @@ inline static void _process_input(ncinput *in, wchar_t wch1, ncinput *in2, wchar
         return;
     }
 
-    for(int i = 0; i < S.input_buffer_len; i++) {
-        if(!isprint(S.input_buffer[i])) {
-            S.input_buffer[i] = '?';
+    logg("Calling <%s>\n", S.input_buffer);
+
+    char was_shown = (S.input_buffer_len > 1);
+    int count = (S.input_count) ? S.input_count : 1;
+
+    input_reset();
+
+    if(was_shown) order_draw_status();
+
+    if(count_use == BIND_COUNT_NUM) {
+        ((num_tusk)att)(count);
+        return;
+    }
+
+    // only the commands that make sense repeated are, "3cwo" switches windows
+    // three times and is drawn once. the others drop the count: "3i" is just "i"
+    if(count_use != BIND_COUNT_REPEAT) count = 1;
+
+    if(count > 1) draw_hold();
+
+    for(int i = 0; i < count; i++) {
+        att();
+    }
+
+    if(count > 1) draw_release();
+}
+
+// the next key. keys that are already queued are applied with drawing held,
+// the draws are let through once the queue is empty
+inline static wchar_t input_get(ncinput *in) {
+    wchar_t ch = notcurses_get_nblock(S.nc, in);
+
+    if(ch && ch != (wchar_t)-1) {
+        draw_hold();
+        return ch;
+    }
+
+    draw_release();
+
+    return notcurses_get_blocking(S.nc, in);
+}
+
+// process the recorded keys once, without any timing.
+// the caller holds the drawing and sets S.macro_playing
+void macro_replay() {
+    for(int i = 0; i < S.macro->len; i++) {
+        macro_key *k = S.macro->keys + i;
+
+        ncinput in = { .id = k->wch1, .modifiers = k->modifiers };
+        ncinput in2 = { .id = k->wch2 };
+
+        _process_input(&in, k->wch1, (k->wch2) ? &in2 : NULL, k->wch2);
+    }
+
+    input_reset(); // an unfinished sequence isn't continued by the next keys
+}
+
+// wait for a key until the monotonic deadline, returns 0 if none came in time.
+// the thread sleeps in notcurses_get meanwhile instead of polling
+inline static wchar_t input_get_until(struct timespec *deadline, ncinput *in) {
+    wchar_t queued = notcurses_get_nblock(S.nc, in);
+
+    if(queued && queued != (wchar_t)-1 && queued != NCKEY_RESIZE) return queued;
+
+    draw_release(); // don't hold the drawing while waiting
+
+    if(queued == NCKEY_RESIZE) on_resize();
+
+    while (1) {
+        if(elapsed_us(deadline) >= 0) return 0;
+
+        wchar_t ch = notcurses_get(S.nc, deadline, in); // the deadline is absolute, not a timeout
+
+        if(ch == NCKEY_RESIZE) {
+            on_resize();
+            continue;
         }
+
+        if(ch == (wchar_t)-1) return 0; // input error
+
+        return ch;
     }
-    logg("Calling <%s>\n", S.input_buffer);
+}
 
-    S.input_buffer[0] = 0;
+#define SIM_CAP_MIN 8000
+#define SIM_CAP_MAX 40000
 
-    if(S.input_buffer_len > 1) {
-        S.input_buffer_len = 0;
-        order_draw_status();
-    } else S.input_buffer_len = 0;
+// can the key begin a simultaneous chord, otherwise there is no need to wait for the second one
+inline static char input_may_chord(ncinput *in, wchar_t wch) {
+    if(wch >= 128 || ncinput_ctrl_p(in)) return 0;
+
+    return _input_binds(state_flag_is_on(FLAG_EDIT))->sim_keys[wch];
+}
+
+// is the chord of the two keys bound after the current input
+inline static char input_is_chord(wchar_t wch1, wchar_t wch2) {
+    if(wch1 >= 128 || wch2 >= 128) return 0;
+
+    char ch1 = binds_key(wch1), ch2 = binds_key(wch2);
+    char keys[4] = { BINDS_CHORD_OPEN, (ch1 < ch2) ? ch1 : ch2, (ch1 < ch2) ? ch2 : ch1, BINDS_CHORD_CLOSE };
+    int node = S.input_node;
+
+    return _input_step(&node, keys, 4, state_flag_is_on(FLAG_EDIT), NULL) != NULL;
+}
+
+// text typed while waiting for a chord is inserted right away,
+// and erased again if the chord is completed
+typedef struct speculation {
+    window *w;
+    int changes; // buffer's changes right after the insertion
+    int macro_len; // macro's length after recording the key
+} speculation;
+
+inline static char input_speculate(speculation *spec, ncinput *in, wchar_t wch) {
+    if(!S.current_window || !S.current_window->buff) return 0;
+    if(state_flag_is_off(FLAG_EDIT)) return 0;
+    if(S.input_buffer_len) return 0;
+    if(ncinput_ctrl_p(in) || !iswprint(wch)) return 0;
+
+    char seq[2] = { binds_key(wch), 0 };
+
+    if(_input_binds_get(seq, 1)) return 0; // not a text key
+
+    _process_edit(wch);
+    macro_record(wch, 0, 0);
 
-    att();
+    spec->w = S.current_window;
+    spec->changes = S.current_window->buff->changes;
+    spec->macro_len = S.macro->len;
+
+    return 1;
+}
+
+inline static void input_rollback(speculation *spec) {
+    window *w = S.current_window;
+
+    if(S.macro_recording && S.macro->len == spec->macro_len) {
+        S.macro->len--; // the chord is recorded instead
+    }
+
+    // something else has happened meanwhile, leave it as it is
+    if(w != spec->w || !w->buff || w->buff->changes != spec->changes) return;
+
+    buffer_erase_at_cursor();
+}
+
+// sim_cap follows the user's cadence: long enough for their chords,
+// but shorter than the gaps between their ordinary keys
+inline static void input_cadence(suseconds_t gap, char is_chord) {
+    if(is_chord) {
+        S.chord_gap = (S.chord_gap * 7 + gap) / 8;
+    } else if(gap < 1000000) { // pauses aren't typing
+        S.key_gap = (S.key_gap * 7 + gap) / 8;
+    } else return;
+
+    suseconds_t cap = S.chord_gap * 2;
+
+    if(cap > S.key_gap / 2) cap = S.key_gap / 2;
+    if(cap < SIM_CAP_MIN) cap = SIM_CAP_MIN;
+    if(cap > SIM_CAP_MAX) cap = SIM_CAP_MAX;
+
+    S.sim_cap = cap;
+}
+
+// keys inserted as they are in the edit mode when they come in a paste
+inline static char input_is_text(ncinput *in, wchar_t wch) {
+    if(ncinput_ctrl_p(in) || ncinput_alt_p(in)) return 0;
+
+    return iswprint(wch) || wch == L'\t' || _is_newline(wch);
+}
+
+// process keys that came at once, a pair of them may still be a chord
+inline static void input_replay(wchar_t *keys, int n) {
+    ncinput none = { 0 };
+
+    for(int i = 0; i < n; i++) {
+        if(i + 1 < n && input_may_chord(&none, keys[i]) && input_is_chord(keys[i], keys[i + 1])) {
+            _process_input(&none, keys[i], &none, keys[i + 1]);
+            i++;
+        } else {
+            _process_input(&none, keys[i], NULL, 0);
+        }
+    }
+}
+
+// record the keys of a paste while a macro is being recorded
+inline static void _input_paste_record(wchar_t *keys, int n) {
+    for(int i = 0; i < n; i++) {
+        macro_record(keys[i], 0, 0);
+    }
+}
+
+// insert the keys of a paste at once. a prompt takes them up to a newline, which
+// runs it's callback, the rest goes on as keys unless the edit mode goes on as well
+inline static void _input_paste_insert(wchar_t *keys, int n) {
+    int done = 0;
+
+    while(done < n && S.current_window) {
+        int inserted = buffer_insert_text_at_cursor(S.current_window, keys + done, n - done);
+
+        if(inserted < 0) break;
+
+        _input_paste_record(keys + done, inserted);
+        done += inserted;
+
+        if(done == n) break;
+
+        // the newline the prompt has stopped at, \r\n is a single one
+        int nl = (keys[done] == L'\r' && done + 1 < n && keys[done + 1] == L'\n') ? 2 : 1;
+
+        _input_paste_record(keys + done, nl);
+        _process_edit(L'\n');
+        done += nl;
+
+        if(state_flag_is_off(FLAG_EDIT)) {
+            input_replay(keys + done, n - done);
+            break;
+        }
+    }
+}
+
+// notcurses reports the bracketed paste markers as NCKEY_PASTE where it supports them.
+// the text keys between the markers are inserted at once, bypassing the binds and the chords.
+// keys are never taken for a paste by how fast they come: typeahead over a slow link
+// comes just as fast and must go through the binds, it's only drawn once (see input_get).
+// returns the key to go on with as usual (in is set for it), 0 if none is left
+inline static wchar_t input_paste(ncinput *in, wchar_t ch) {
+    wstr *keys = S.paste;
+
+    keys->len = 0;
+    wstr_append(keys, ch);
+
+    while (1) {
+        ch = notcurses_get_nblock(S.nc, in);
+
+        if(ch == NCKEY_RESIZE) {
+            on_resize();
+            continue;
+        }
+
+        if(!ch || ch == (wchar_t)-1) {
+            ch = 0;
+            break;
+        }
+
+#ifdef NCKEY_PASTE
+        if(ch == NCKEY_PASTE) { // the end of the paste
+            S.pasting = 0;
+            ch = 0;
+            break;
+        }
+#endif
+
+        if(!input_is_text(in, ch)) break;
+
+        wstr_append(keys, ch);
+    }
+
+    logg("Paste of %d keys\n", keys->len);
+
+    _input_paste_insert(keys->wcs, keys->len);
+
+    return ch;
 }
 
 void *input_loop(void*) {
-    static struct timeval start, stop;
-    static char flag_sim = 0;
-    static wchar_t last_char, ch;
     ncinput in, in2;
+    wchar_t ch = 0; // a key left from the last chord wait
+    struct timespec pressed;
 
     while (1) {
-        if(flag_sim) {
-            ch = notcurses_get_nblock(S.nc, &in2);
+        if(state_flag_is_on(FLAG_EXIT)) {
+            draw_release(); // the draw loop must see the exit
+            break;
+        }
+
+        if(!ch) {
+            ch = input_get(&in);
 
             if(ch == NCKEY_RESIZE) {
                 on_resize();
+                ch = 0;
                 continue;
             }
 
-            gettimeofday(&stop, NULL);
+#ifdef NCKEY_PASTE
+            if(ch == NCKEY_PASTE) { // the beginning or the end of a bracketed paste
+                S.pasting = !S.pasting;
+                ch = 0;
+                continue;
+            }
+#endif
 
-            suseconds_t diff = ((stop.tv_sec - start.tv_sec) * 1000000 + stop.tv_usec - start.tv_usec);
+            clock_gettime(CLOCK_MONOTONIC, &pressed);
 
-            if(diff > S.sim_cap) {
-                flag_sim = 0;
-                _process_input(&in, last_char, NULL, 0);
-            } else {
-                if(ch) {
-                    flag_sim = 0;
-                    _process_input(&in, last_char, &in2, ch);
-                }
+            if(S.pasting && state_flag_is_on(FLAG_EDIT) && !S.input_buffer_len && S.current_window
+            && input_is_text(&in, ch)) {
+                ch = input_paste(&in, ch);
+
+                if(!ch) continue;
+
+                clock_gettime(CLOCK_MONOTONIC, &pressed);
             }
+        }
 
+        if(!input_may_chord(&in, ch)) {
+            _process_input(&in, ch, NULL, 0);
+            ch = 0;
             continue;
         }
-        
-        if(state_flag_is_on(FLAG_EXIT)) break;
 
-        wchar_t nch = notcurses_get_blocking(S.nc, &in);
+        speculation spec;
+        char is_spec = input_speculate(&spec, &in, ch);
 
-        if(nch == NCKEY_RESIZE) {
-            on_resize();
+        // a second key within S.sim_cap makes both a simultaneous chord
+        struct timespec deadline = pressed, cpu_start, cpu_stop;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+
+        deadline.tv_nsec += (S.sim_cap % 1000000) * 1000;
+        deadline.tv_sec += S.sim_cap / 1000000 + deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        wchar_t ch2 = input_get_until(&deadline, &in2);
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_stop);
+        logg("Sim wait: %ld us of cpu\n", (cpu_stop.tv_sec - cpu_start.tv_sec) * 1000000 +
+            (cpu_stop.tv_nsec - cpu_start.tv_nsec) / 1000);
+
+        if(!ch2) {
+            if(!is_spec) _process_input(&in, ch, NULL, 0);
+            ch = 0;
             continue;
         }
 
-        last_char = nch;
-        flag_sim = 1;
-        gettimeofday(&start, NULL);
+        suseconds_t gap = elapsed_us(&pressed);
+
+        if(input_is_chord(ch, ch2)) {
+            if(is_spec) input_rollback(&spec);
+
+            input_cadence(gap, 1);
+            logg("Chord in %ld us, sim cap %ld us\n", (long)gap, (long)S.sim_cap);
+
+            _process_input(&in, ch, &in2, ch2);
+            ch = 0;
+        } else { // the second key may begin a chord itself
+            if(!is_spec) _process_input(&in, ch, NULL, 0);
+
+            input_cadence(gap, 0);
+
+            in = in2;
+            ch = ch2;
+            clock_gettime(CLOCK_MONOTONIC, &pressed);
+        }
     }
 
     pthread_exit(NULL);
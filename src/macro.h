@@ -0,0 +1,82 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_MACRO_H_
+#define __UNN_MACRO_H_
+
+#include <stdlib.h>
+#include <wchar.h>
+
+// a key as it was processed, wch2 is set for simultaneous chords
+typedef struct macro_key {
+    wchar_t wch1, wch2;
+    unsigned modifiers; // ncinput's, of wch1
+} macro_key;
+
+// recorded keys, replayed without the input loop's timing
+typedef struct macro {
+    int len, cap;
+    macro_key *keys;
+} macro;
+
+void macro_free(macro *m) {
+    if(!m) return;
+    free(m->keys);
+    free(m);
+}
+
+macro *macro_new(int cap) {
+    if(cap <= 0) return NULL;
+
+    macro *m = (macro *)malloc(sizeof(*m));
+
+    if(!m) return NULL;
+
+    macro_key *keys = (macro_key *)malloc(sizeof(*keys) * cap);
+
+    if(!keys) {
+        free(m);
+        return NULL;
+    }
+
+    *m = (macro) {
+        .len = 0,
+        .cap = cap,
+        .keys = keys,
+    };
+
+    return m;
+}
+
+// returns -1 if not enough memory
+int macro_append(macro *m, macro_key key) {
+    if(m->len == m->cap) {
+        macro_key *keys = (macro_key *)realloc(m->keys, sizeof(*keys) * m->cap * 2);
+
+        if(!keys) return -1;
+
+        m->keys = keys;
+        m->cap *= 2;
+    }
+
+    m->keys[m->len++] = key;
+
+    return 0;
+}
+
+#endif
@@ -21,6 +21,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -31,12 +32,16 @@
 #include "window.h"
 #include "err.h"
 #include "bind.h"
+#include "kill.h"
+#include "macro.h"
 
 #define FLAG_EDIT 1
 #define FLAG_VIEW 2
 #define FLAG_FAST 4
 #define FLAG_EXIT 8
 
+#define FRAME_RATE 60 // most frames drawn per second, 0 for no limit
+
 typedef struct state {
     struct notcurses *nc;
     struct ncplane *p; // stdplane
@@ -62,23 +67,46 @@ typedef struct state {
     win_colors colors_prompt;
     
     sem_t draw_request;
-    int draw_windows_count, draw_windows_count2; // two queues to not make other thread wait while
-    window **draw_windows;                       // draw loop processes it
-    window **draw_windows2;
+    atomic_int draw_windows_pending; // some window's draw_pending is set, see order_draw_window
+    atomic_char draw_hold; // the input loop is applying queued keys, draw requests wait for it
+    atomic_char draw_deferred; // a draw was ordered while held
+    struct timespec draw_hold_start;
+    char edits_held; // edited buffers get a transaction until edits_release, see edits_hold
+    struct buffer *tx_held; // the buffers with such a transaction
 
     wchar_t status_message[512];
 
+    long frame_budget; // minimal microseconds between two drawn frames, 0 for no limit
+
     suseconds_t sim_cap; // microseconds cap for two keys pressed to count as simultaneous
+    suseconds_t key_gap, chord_gap; // averages of the user's typing cadence, sim_cap adapts to them
     int input_buffer_len;
-    char input_buffer[16]; // current keybind input
+    char input_buffer[16]; // current keybind input, as shown in the status
+    int input_node; // current input's node in the merged binds, 0 (the root) if none
+    int input_count; // count typed before the current input, 0 if none
+
+    macro *macro; // the last recorded keys
+    char macro_recording, macro_playing;
+    int macro_seq_start; // macro's length before the current input, the stopping input is cut off
+    wstr *paste; // pasted keys, see input_paste
+    char pasting; // between the bracketed paste markers
+    kill_ring *kills; // copied selections
     
+    sem_t raster_request;
+    char raster_missed; // a frame was dropped while rasterizing, a new one is needed
+
+    sem_t highlight_request;
+
     pthread_mutex_t draw_block; // block drawing loop
+    pthread_mutex_t raster_block; // block rendering/rasterizing of a frame
+    pthread_mutex_t raster_flags_block; // lock raster_missed for editing/reading
     pthread_mutex_t draw_flags_block; // lock drawing flags for editing/reading
     pthread_mutex_t status_message_block; // lock status_message for editing/reading
     pthread_mutex_t state_flags_block; // lock state flags for editing/reading
+    pthread_mutex_t highlight_block; // lock blist from being changed while the highlight loop walks it
     
-    pthread_t iloop, dloop;
-    char done; // if != 0 then we wait for iloop, dloop to end, deinit everything and exit
+    pthread_t iloop, dloop, rloop, hloop;
+    char done; // if != 0 then we wait for iloop, dloop, rloop, hloop to end, deinit everything and exit
 } state;
 
 // currently, memory allocations are either OK or panic
@@ -103,11 +131,24 @@ int state_init(state *s, err *e) {
         return -3;
     }
 
+    if(sem_init(&s->raster_request, 0, 0)) {
+        err_set(e, -3, L"sem_init for raster_request failed");
+        return -3;
+    }
+
+    if(sem_init(&s->highlight_request, 0, 0)) {
+        err_set(e, -3, L"sem_init for highlight_request failed");
+        return -3;
+    }
+
     // always return 0
     pthread_mutex_init(&s->draw_flags_block, NULL);
     pthread_mutex_init(&s->status_message_block, NULL);
     pthread_mutex_init(&s->state_flags_block, NULL);
     pthread_mutex_init(&s->draw_block, NULL);
+    pthread_mutex_init(&s->raster_block, NULL);
+    pthread_mutex_init(&s->raster_flags_block, NULL);
+    pthread_mutex_init(&s->highlight_block, NULL);
 
     s->grid = (grid *)calloc(1, sizeof(*s->grid));
     if(!s->grid) {
@@ -147,21 +188,32 @@ int state_init(state *s, err *e) {
         return -4;
     }
 
-    s->draw_windows = (window **)malloc(sizeof(*s->draw_windows) * 16);
-    if(!s->draw_windows) {
+    s->input_buffer_len = 0;
+
+    s->pasting = 0;
+    s->paste = wstr_new(256);
+    if(!s->paste) {
         err_set(e, -4, L"not enough memory");
         return -4;
     }
 
-    s->draw_windows2 = (window **)malloc(sizeof(*s->draw_windows2) * 16);
-    if(!s->draw_windows2) {
+    s->macro = macro_new(64);
+    if(!s->macro) {
         err_set(e, -4, L"not enough memory");
         return -4;
     }
 
-    s->input_buffer_len = 0;
+    s->kills = kill_ring_new();
+    if(!s->kills) {
+        err_set(e, -4, L"not enough memory");
+        return -4;
+    }
 
     s->sim_cap = 25000; // microseconds, max 999999
+    s->key_gap = 200000;
+    s->chord_gap = 12500;
+
+    s->frame_budget = (FRAME_RATE) ? 1000000 / FRAME_RATE : 0;
 
     s->done = 0;
 
@@ -189,18 +241,21 @@ void state_deinit(state *s) {
     binds_free(s->binds_edit);
     binds_free(s->binds_prompt);
 
-    if(s->draw_windows)
-        free(s->draw_windows);
-    
-    if(s->draw_windows2)
-        free(s->draw_windows2);
+    wstr_free(s->paste);
+    macro_free(s->macro);
+    kill_ring_free(s->kills);
 
     // not sure if I should check if those are init'd
     sem_destroy(&s->draw_request);
+    sem_destroy(&s->raster_request);
+    sem_destroy(&s->highlight_request);
     pthread_mutex_destroy(&s->draw_flags_block);
     pthread_mutex_destroy(&s->status_message_block);
     pthread_mutex_destroy(&s->state_flags_block);
     pthread_mutex_destroy(&s->draw_block);
+    pthread_mutex_destroy(&s->raster_block);
+    pthread_mutex_destroy(&s->raster_flags_block);
+    pthread_mutex_destroy(&s->highlight_block);
 
     logg("State deinitialized\n");
 }
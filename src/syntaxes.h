@@ -0,0 +1,127 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_SYNTAXES_H_
+#define __UNN_SYNTAXES_H_
+
+#include <wchar.h>
+
+#include "highlight.h"
+
+// compile-time edit only, rules are tried in order at every position
+
+const wchar_t *C_KEYWORDS[] = {
+    L"if", L"else", L"for", L"while", L"do", L"switch", L"case", L"default",
+    L"break", L"continue", L"return", L"goto", L"sizeof", L"typedef",
+    L"static", L"inline", L"extern", L"const", L"volatile", L"register",
+    L"struct", L"union", L"enum", L"restrict", NULL,
+};
+
+const wchar_t *C_TYPES[] = {
+    L"void", L"char", L"short", L"int", L"long", L"float", L"double",
+    L"signed", L"unsigned", L"size_t", L"wchar_t", L"NULL", NULL,
+};
+
+const hl_rule C_RULES[] = {
+    { HL_RULE_SPAN, HL_COMMENT, HL_RULE_MULTILINE, L"/*", L"*/", 0, NULL },
+    { HL_RULE_LINE, HL_COMMENT, 0, L"//", NULL, 0, NULL },
+    { HL_RULE_LINE, HL_PREPROC, HL_RULE_BOL, L"#", NULL, 0, NULL },
+    { HL_RULE_SPAN, HL_STRING, 0, L"\"", L"\"", L'\\', NULL },
+    { HL_RULE_SPAN, HL_STRING, 0, L"'", L"'", L'\\', NULL },
+    { HL_RULE_WORDS, HL_KEYWORD, 0, NULL, NULL, 0, C_KEYWORDS },
+    { HL_RULE_WORDS, HL_TYPE, 0, NULL, NULL, 0, C_TYPES },
+    { HL_RULE_NUMBER, HL_NUMBER, 0, NULL, NULL, 0, NULL },
+};
+
+const wchar_t *SH_KEYWORDS[] = {
+    L"if", L"then", L"elif", L"else", L"fi", L"for", L"while", L"until",
+    L"do", L"done", L"case", L"esac", L"in", L"function", L"return",
+    L"local", L"export", L"readonly", L"shift", L"exit", NULL,
+};
+
+const hl_rule SH_RULES[] = {
+    { HL_RULE_LINE, HL_COMMENT, 0, L"#", NULL, 0, NULL },
+    { HL_RULE_SPAN, HL_STRING, HL_RULE_MULTILINE, L"\"", L"\"", L'\\', NULL },
+    { HL_RULE_SPAN, HL_STRING, HL_RULE_MULTILINE, L"'", L"'", 0, NULL },
+    { HL_RULE_SPAN, HL_TYPE, 0, L"${", L"}", 0, NULL },
+    { HL_RULE_WORDS, HL_KEYWORD, 0, NULL, NULL, 0, SH_KEYWORDS },
+    { HL_RULE_NUMBER, HL_NUMBER, 0, NULL, NULL, 0, NULL },
+};
+
+const wchar_t *JSON_KEYWORDS[] = {
+    L"true", L"false", L"null", NULL,
+};
+
+const hl_rule JSON_RULES[] = {
+    { HL_RULE_SPAN, HL_STRING, 0, L"\"", L"\"", L'\\', NULL },
+    { HL_RULE_WORDS, HL_KEYWORD, 0, NULL, NULL, 0, JSON_KEYWORDS },
+    { HL_RULE_NUMBER, HL_NUMBER, 0, NULL, NULL, 0, NULL },
+};
+
+const wchar_t *LOG_ERRORS[] = {
+    L"ERROR", L"error", L"FATAL", L"fatal", L"CRITICAL", L"PANIC", NULL,
+};
+
+const wchar_t *LOG_WARNINGS[] = {
+    L"WARN", L"WARNING", L"warning", NULL,
+};
+
+const wchar_t *LOG_LEVELS[] = {
+    L"INFO", L"DEBUG", L"TRACE", L"NOTICE", NULL,
+};
+
+const hl_rule LOG_RULES[] = {
+    { HL_RULE_WORDS, HL_ERROR, 0, NULL, NULL, 0, LOG_ERRORS },
+    { HL_RULE_WORDS, HL_WARNING, 0, NULL, NULL, 0, LOG_WARNINGS },
+    { HL_RULE_WORDS, HL_KEYWORD, 0, NULL, NULL, 0, LOG_LEVELS },
+    { HL_RULE_SPAN, HL_STRING, 0, L"\"", L"\"", L'\\', NULL },
+    { HL_RULE_NUMBER, HL_NUMBER, 0, NULL, NULL, 0, NULL },
+};
+
+#define SYNTAX_RULES(_rules) _rules, sizeof(_rules) / sizeof(*(_rules))
+
+const wchar_t *C_EXTS[] = { L".c", L".h", L".cc", L".cpp", L".hpp", NULL };
+const wchar_t *SH_EXTS[] = { L".sh", L".bash", L".zsh", NULL };
+const wchar_t *JSON_EXTS[] = { L".json", NULL };
+const wchar_t *LOG_EXTS[] = { L".log", NULL };
+
+const syntax SYNTAXES[] = {
+    { L"C", C_EXTS, SYNTAX_RULES(C_RULES) },
+    { L"shell", SH_EXTS, SYNTAX_RULES(SH_RULES) },
+    { L"JSON", JSON_EXTS, SYNTAX_RULES(JSON_RULES) },
+    { L"log", LOG_EXTS, SYNTAX_RULES(LOG_RULES) },
+};
+
+// pick a syntax by the path's extension, NULL if none matches
+const syntax *syntax_for_path(const wchar_t *path) {
+    if(!path) return NULL;
+
+    const wchar_t *ext = wcsrchr(path, L'.');
+
+    if(!ext || wcschr(ext, L'/')) return NULL;
+
+    for(int i = 0; i < sizeof(SYNTAXES) / sizeof(*SYNTAXES); i++) {
+        for(const wchar_t **e = SYNTAXES[i].exts; *e; e++) {
+            if(!wcscmp(ext, *e)) return SYNTAXES + i;
+        }
+    }
+
+    return NULL;
+}
+
+#endif
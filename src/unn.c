@@ -25,7 +25,9 @@
 
 /*
     FILES:
-        bind.h - bindings primitive hash map implementation
+        anchor.h - positions in a buffer that follow it's edits
+        bench.h - render microbenchmark, built instead of the editor with BENCH (bench.sh)
+        bind.h - bindings trie, stepped one key at a time
         binds.h - arrays of default bindings
         buffer.h - UNN's general buffer implementation
         colors.h - useful structures and definitions for coloring, colored buffer, etc.
@@ -33,17 +35,23 @@
         draw.h - window, status, grid drawing functions
         err.h - simple error handling structure and functions, mainly forgotten about
         flags.h - primitive bitwise manipulation definitions for flagging
+        grapheme.h - grapheme cluster boundaries, a compact subset of UAX #29
         helpers.h - misc. functions mainly used by commands.h
+        highlight.h - incremental rule-driven syntax highlighting engine
+        kill.h - kill ring of copied selections, sharing the chars of the lines
         lparse.h - crude Scheme Lisp one-step parser
         lmode.h - an implementation of a special mode that helps coding in Lisp greatly
         lisp.h - header for functions that some Lisp implementation should export for UNN to use
         list.h - simple doubly-linked list implementation
         line.h - mutable attributed wide char string implementation
         logic.h - main logic implemented in functions, draw/input loop functions
+        macro.h - recorded keys for replaying them
         misc.h - miscallenous types and definitios
         panic.h - exposes a single function that simply panics (aborts)
         state.h - general UNN state expressed by a single structure and it's helper functions
+        syntaxes.h - arrays of highlighting rules for supported file formats
         window.h - general definitions for window, grid, etc. and it's helper functions
+        width.h - display width (terminal cells) lookup table for wide chars
         wstr.h - dynamic wide char c-string wrapper and helper functions
         unn.c - state + logic glue and bootstrapper
 
@@ -136,6 +144,8 @@
         unn modularity
 */
 
+#define _GNU_SOURCE // wcwidth
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -191,8 +201,13 @@ err e = { 0 };
 #include "logic.h"
 #include "binds.h"
 
+#ifdef BENCH
+#include "bench.h"
+#endif
+
 void unn_cleanup() {
     state_deinit(&S);
+    width_free();
 
     pthread_mutex_destroy(&log_mutex);
 
@@ -265,17 +280,31 @@ void unn_run() {
 
     pthread_create(&S.iloop, NULL, input_loop, NULL);
     pthread_create(&S.dloop, NULL, draw_loop, NULL);
+    pthread_create(&S.rloop, NULL, raster_loop, NULL);
+    pthread_create(&S.hloop, NULL, highlight_loop, NULL);
 
     pthread_join(S.iloop, NULL);
     pthread_join(S.dloop, NULL);
+    pthread_join(S.rloop, NULL);
+    pthread_join(S.hloop, NULL);
 
-    logg("Both threads exited\n");
+    logg("All threads exited\n");
 
     S.done = 1; // signal state_deinit that threads are done
 }
 
 int main(int argc, char **argv) {
     setlocale(LC_ALL, "");
+
+    #ifdef BENCH
+    atexit(bench_print); // after unn_cleanup has stopped notcurses
+
+    unn_init();
+    bench_run();
+
+    S.done = 1; // no threads were started
+    return 0;
+    #endif
     
     unn_init();
     unn_run();
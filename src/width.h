@@ -0,0 +1,121 @@
+/*
+    UNN - text editor with high ambitions and far-fetched goals
+    Copyright (C) 2025  Sergei Igolnikov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __UNN_WIDTH_H_
+#define __UNN_WIDTH_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <pthread.h>
+
+// terminal cells taken by a wide char: 0 for combining marks, 2 for CJK, emoji, etc.
+// two-level lookup table: code points are split into pages of 256,
+// each page is filled from wcwidth when it's first needed.
+// pages consisting only of narrow chars share a single page
+
+#define WIDTH_PAGE_BITS 8
+#define WIDTH_PAGE_SIZE (1 << WIDTH_PAGE_BITS)
+#define WIDTH_PAGES (0x110000 >> WIDTH_PAGE_BITS)
+
+unsigned char *width_pages[WIDTH_PAGES] = { 0 };
+unsigned char width_page_narrow[WIDTH_PAGE_SIZE];
+
+pthread_mutex_t width_block = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned char *_width_page_fill(int page) {
+    pthread_mutex_lock(&width_block);
+
+    if(width_pages[page]) { // filled by another thread meanwhile
+        pthread_mutex_unlock(&width_block);
+        return width_pages[page];
+    }
+
+    unsigned char tmp[WIDTH_PAGE_SIZE];
+    char narrow = 1;
+
+    for(int i = 0; i < WIDTH_PAGE_SIZE; i++) {
+        int w = wcwidth((wchar_t)((page << WIDTH_PAGE_BITS) | i));
+
+        // non-printable chars are still drawn somehow
+        tmp[i] = (w < 0) ? 1 : w;
+
+        if(tmp[i] != 1) narrow = 0;
+    }
+
+    unsigned char *p = width_page_narrow;
+
+    if(narrow) {
+        memset(width_page_narrow, 1, sizeof(width_page_narrow));
+    } else {
+        p = (unsigned char *)malloc(WIDTH_PAGE_SIZE);
+
+        if(!p) { // can't cache it, pretend it's narrow
+            pthread_mutex_unlock(&width_block);
+            return NULL;
+        }
+
+        memcpy(p, tmp, WIDTH_PAGE_SIZE);
+    }
+
+    width_pages[page] = p;
+
+    pthread_mutex_unlock(&width_block);
+
+    return p;
+}
+
+inline static int wch_width(wchar_t wch) {
+    if(wch >= 0x20 && wch < 0x7f) return 1; // ASCII fast path
+    if(wch < 0 || wch >= 0x110000) return 1;
+
+    int page = wch >> WIDTH_PAGE_BITS;
+
+    unsigned char *p = width_pages[page];
+
+    if(!p) {
+        p = _width_page_fill(page);
+        if(!p) return 1;
+    }
+
+    return p[wch & (WIDTH_PAGE_SIZE - 1)];
+}
+
+// cells taken by the first len chars of wcs
+inline static int wcs_width(const wchar_t *wcs, int len) {
+    int width = 0;
+
+    for(int i = 0; i < len; i++) {
+        width += wch_width(wcs[i]);
+    }
+
+    return width;
+}
+
+void width_free() {
+    for(int i = 0; i < WIDTH_PAGES; i++) {
+        if(width_pages[i] && width_pages[i] != width_page_narrow) {
+            free(width_pages[i]);
+        }
+
+        width_pages[i] = NULL;
+    }
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "misc.h"
 #include "flags.h"
@@ -37,6 +38,9 @@
 #define WINDOW_WRAP 8
 #define WINDOW_DEFAULT (WINDOW_LINES | WINDOW_LONG_MARKS)
 
+#define SELECTION_LINEAR 1 // from one position to the other one
+#define SELECTION_RECT 2 // columns between the two positions on the lines between them
+
 typedef struct rect {
     int y1, x1;
     int y2, x2;
@@ -52,6 +56,33 @@ typedef struct offset {
     line *l;
 } offset;
 
+// a single visual row of a wrapped window: line and the position it starts from
+typedef struct wrap_row {
+    line *l;
+    int index;
+    int pos;
+    int row; // visual row of the line
+} wrap_row;
+
+// window's state at the moment of it's last drawing,
+// used by draw_window to redraw only what's needed
+typedef struct window_drawn {
+    char valid; // 0 if the window's region must be fully redrawn
+    char focused;
+    int flags;
+    int dc;
+    int changes; // buffer's changes counter
+    int hl_changes; // buffer's background highlighting counter
+    int sel_mode;
+    buffer *buff;
+    rect pos;
+    offset view, cur;
+} window_drawn;
+
+#define GUTTER_UNKNOWN -1
+#define GUTTER_EMPTY 0 // row after the buffer's end
+#define GUTTER_WRAPPED -2 // continuation of a wrapped line
+
 typedef struct window {
     struct window *prev, *next;
 
@@ -62,12 +93,280 @@ typedef struct window {
     win_colors cl;
 
     int flags;
-    int last_pos; // for cursor vertical movement features
+    int last_col; // visual column kept by cursor vertical movement
     int dc; // digits count for line numbers
 
+    window_drawn drawn;
+    atomic_char draw_pending; // set by order_draw_window, cleared by the draw loop
+    char draw_busy; // frames in a row the window wasn't drawn, the buffer's block was taken
+
+    line *snap; // copies of the shown lines, drawn without holding the buffer's block
+    int snap_cap;
+
+    int *gutter; // line numbers drawn at each row, see GUTTER_* for special values
+    int gutter_len;
+
+    // visual rows of the view when wrapping, rebuilt lazily
+    // when the view, the buffer or the window's size change
+    wrap_row *wrap_map;
+    int wrap_map_len;
+    int wrap_width, wrap_changes;
+    offset wrap_view;
+
+    // cur and view put in the buffer's anchors while another window edits it
+    anchor cur_anchor, view_anchor;
+
+    // the selection is between sel_anchor and the cursor, see SELECTION_*. 0 if there's none
+    int sel_mode;
+    anchor sel_anchor;
+    offset sel; // sel_anchor's position, taken with the snapshot for drawing
+    int sel_cols[2]; // columns of sel and cur, same
+
     callback on_destroy;
 } window;
 
+void window_free(window *w) {
+    if(!w) return;
+
+    anchor_detach(&w->cur_anchor);
+    anchor_detach(&w->view_anchor);
+    anchor_detach(&w->sel_anchor);
+
+    if(w->gutter)
+        free(w->gutter);
+
+    if(w->wrap_map)
+        free(w->wrap_map);
+
+    for(int i = 0; i < w->snap_cap; i++) {
+        free(w->snap[i].dstr);
+        free(w->snap[i].cols);
+        free(w->snap[i].rows);
+        free(w->snap[i].bounds);
+    }
+
+    if(w->snap)
+        free(w->snap);
+
+    free(w);
+}
+
+int digits_count(int number) {
+    int d = 1;
+
+    number = number / 10;
+
+    while(number) {
+        d++;
+        number = number / 10;
+    }
+
+    return d;
+}
+
+// digits count for line numbers as draw_window computes it for the current view
+inline static int window_dc(window *w) {
+    if(!flag_is_on(w->flags, WINDOW_LINES)) return 0;
+
+    return digits_count(w->view.index + (w->pos.y2 - w->pos.y1 + 1) + 1);
+}
+
+// width of the window's text area, without line numbers and long line marks
+inline static int window_text_width(window *w) {
+    int dc = window_dc(w);
+    if(dc) dc++;
+
+    int is_markers = !!flag_is_on(w->flags, WINDOW_LONG_MARKS);
+
+    int tw = w->pos.x2 - w->pos.x1 + 1 - dc - is_markers;
+
+    return (tw > 0) ? tw : 1;
+}
+
+// the selection's ends in the buffer's order, from sel taken by window_sel_take
+inline static void window_sel_ends(window *w, offset *from, offset *to) {
+    *from = w->sel;
+    *to = w->cur;
+
+    if(from->index > to->index || (from->index == to->index && from->pos > to->pos)) {
+        *from = w->cur;
+        *to = w->sel;
+    }
+}
+
+// positions of the line selected in the window, from sel and sel_cols.
+// returns 0 if the line isn't in the selection, from and to may be equal otherwise
+inline static int window_sel_range(window *w, line *l, int index, int *from, int *to) {
+    if(!w->sel_mode) return 0;
+
+    offset a, b;
+    window_sel_ends(w, &a, &b);
+
+    if(index < a.index || index > b.index) return 0;
+
+    if(w->sel_mode == SELECTION_RECT) {
+        int lo = w->sel_cols[0], hi = w->sel_cols[1];
+
+        if(lo > hi) {
+            lo = w->sel_cols[1];
+            hi = w->sel_cols[0];
+        }
+
+        *from = line_pos_at_col(l, lo);
+        *to = line_pos_at_col(l, hi);
+    } else {
+        *from = (index == a.index) ? a.pos : 0;
+        *to = (index == b.index) ? b.pos : l->len;
+    }
+
+    return 1;
+}
+
+// put the position of w's selection anchor into dst's sel and sel_cols, dst's selection
+// is dropped if the anchor isn't in w's buffer. the buffer's block is held
+inline static void window_sel_take(window *w, window *dst) {
+    if(!w->sel_mode || w->sel_anchor.owner != &w->buff->anchors) {
+        dst->sel_mode = 0;
+        return;
+    }
+
+    dst->sel = (offset) {
+        .l = w->sel_anchor.l,
+        .index = anchor_index(&w->sel_anchor),
+        .pos = w->sel_anchor.pos,
+    };
+
+    dst->sel_cols[0] = line_col(w->sel_anchor.l, w->sel_anchor.pos);
+    dst->sel_cols[1] = line_col(w->cur.l, w->cur.pos);
+}
+
+// amount of visual rows a line takes when wrapped into tw columns, see line_row_next
+inline static int line_wrap_rows(line *l, int tw) {
+    if(!line_rows_update(l, tw)) return l->rows_len;
+
+    int rows = 1; // no memory, counted every time
+
+    for(int pos = line_row_next(l, tw, 0); pos >= 0; pos = line_row_next(l, tw, pos)) {
+        rows++;
+    }
+
+    return rows;
+}
+
+// visual row the position is at
+inline static int line_pos_row(line *l, int tw, int pos) {
+    if(!line_rows_update(l, tw)) {
+        int lo = 0, hi = l->rows_len - 1; // the last row beginning at pos or before it
+
+        while(lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+
+            if(l->rows[mid] <= pos) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        return lo;
+    }
+
+    int row = 0;
+
+    for(int next = line_row_next(l, tw, 0); next >= 0 && next <= pos; next = line_row_next(l, tw, next)) {
+        row++;
+    }
+
+    return row;
+}
+
+// the first position of a visual row, the last row's one if there are less rows
+inline static int line_row_pos(line *l, int tw, int row) {
+    if(!line_rows_update(l, tw)) {
+        if(row < 0) return 0;
+
+        return l->rows[(row < l->rows_len) ? row : l->rows_len - 1];
+    }
+
+    int pos = 0;
+
+    for(; row > 0; row--) {
+        int next = line_row_next(l, tw, pos);
+
+        if(next < 0) break;
+
+        pos = next;
+    }
+
+    return pos;
+}
+
+// make view.pos point at the beginning of it's visual row,
+// it might not after the text width has changed
+inline static void window_wrap_normalize(window *w, int tw) {
+    w->view.pos = line_row_pos(w->view.l, tw, line_pos_row(w->view.l, tw, w->view.pos));
+}
+
+// when wrapping, view.pos is the position the first visual row of view.l starts from
+// returns NULL if not enough memory
+wrap_row *window_wrap_map(window *w, int tw, int height) {
+    if(w->wrap_map && w->wrap_map_len == height && w->wrap_width == tw &&
+        w->wrap_changes == w->buff->changes &&
+        w->wrap_view.l == w->view.l && w->wrap_view.pos == w->view.pos &&
+        w->wrap_view.index == w->view.index) {
+        return w->wrap_map;
+    }
+
+    if(w->wrap_map_len != height) {
+        wrap_row *map = (wrap_row *)realloc(w->wrap_map, sizeof(*map) * height);
+
+        if(!map) {
+            return NULL;
+        }
+
+        w->wrap_map = map;
+        w->wrap_map_len = height;
+    }
+
+    // the view is normalized on the input thread, the width might have changed since then
+    line *l = w->view.l;
+    int index = w->view.index;
+    int lrow = (l) ? line_pos_row(l, tw, w->view.pos) : 0;
+    int pos = (l) ? line_row_pos(l, tw, lrow) : 0;
+
+    for(int row = 0; row < height; row++) {
+        if(!l) {
+            w->wrap_map[row] = (wrap_row) { 0 };
+            continue;
+        }
+
+        w->wrap_map[row] = (wrap_row) {
+            .l = l,
+            .index = index,
+            .pos = pos,
+            .row = lrow,
+        };
+
+        int next = line_row_next(l, tw, pos);
+
+        if(next >= 0) {
+            pos = next;
+            lrow++;
+        } else {
+            l = l->next;
+            index++;
+            pos = 0;
+            lrow = 0;
+        }
+    }
+
+    w->wrap_width = tw;
+    w->wrap_changes = w->buff->changes;
+    w->wrap_view = w->view;
+
+    return w->wrap_map;
+}
+
 typedef struct grid {
     int windows_count;
     window *first, *last;
@@ -173,7 +472,7 @@ int grid_remove(grid *g, window *w) {
 void grid_free(grid *g) {
     if(!g) return;
 
-    node_free_nexts((node *)g->first, free);
+    node_free_nexts((node *)g->first, (free_func)window_free);
     free(g);
 }
 